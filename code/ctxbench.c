@@ -0,0 +1,56 @@
+// Context switch benchmark.  Two processes bounce a byte
+// back and forth over a pair of pipes, so every round trip
+// is two switches between address spaces.
+//
+// usage: ctxbench [rounds]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int n, i, pid, ab[2], ba[2];
+  int start, elapsed;
+  char c;
+
+  n = 10000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0 || pipe(ab) < 0 || pipe(ba) < 0){
+    printf(2, "usage: ctxbench [rounds]\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(2, "ctxbench: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 0; i < n; i++){
+      if(read(ab[0], &c, 1) != 1 || write(ba[1], &c, 1) != 1)
+        break;
+    }
+    exit();
+  }
+
+  c = 'x';
+  start = uptime();
+  for(i = 0; i < n; i++){
+    if(write(ab[1], &c, 1) != 1 || read(ba[0], &c, 1) != 1){
+      printf(2, "ctxbench: pipe failed\n");
+      break;
+    }
+  }
+  elapsed = uptime() - start;
+  wait();
+
+  // A tick is 10ms.
+  printf(1, "ctxbench: %d switches in %d ticks", 2*n, elapsed);
+  if(elapsed > 0)
+    printf(1, ", %d us per switch", elapsed * 10000 / (2*n));
+  printf(1, "\n");
+  exit();
+}
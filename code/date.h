@@ -7,3 +7,9 @@ struct rtcdate {
   uint month;     //月份
   uint year;      //年份
 };
+
+// Time since boot, from clocktime().
+struct timespec {
+  uint sec;       //秒
+  uint nsec;      //纳秒
+};
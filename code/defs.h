@@ -1,14 +1,24 @@
 struct buf;
 struct context;
 struct file;
+struct files;
 struct inode;
+struct iovec;
 struct pipe;
 struct proc;
+struct rcuhead;
 struct rtcdate;
+struct rwlock;
+struct seqlock;
+struct shm;
 struct spinlock;
 struct sleeplock;
+struct lockclass;
 struct stat;
 struct superblock;
+struct timespec;
+struct trapframe;
+struct vma;
 
 // bio.c
 void            binit(void);    
@@ -26,13 +36,25 @@ void            panic(char*) __attribute__((noreturn));
 int             exec(char*, char**);
 
 // file.c
+int             fdalloc(struct file*);
+struct file*    fdfree(int);
+struct file*    fdget(int);
+void            fdput(int);
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int, int);
+struct files*   filesalloc(void);
+struct files*   filescopy(struct files*);
+struct files*   filesdup(struct files*);
+void            filesput(struct files*);
+int             fileseek(struct file*, int, int);
+int             filesend(struct file*, struct file*, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -42,6 +64,8 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
+void            iunlockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -50,9 +74,14 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+int             readiput(struct inode*, uint, uint, int (*)(void*, char*, int), void*);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+int             futex(uint, int, int);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -65,9 +94,16 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+void            kdup(char*);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+char*           ksuperalloc(void);
+void            ksuperfree(char*);
+void            ksplit(char*);
+int             kfreecount(void);
+int             kref(char*);
+int             kunref(char*);
 
 // kbd.c
 void            kbdintr(void);
@@ -76,10 +112,16 @@ void            kbdintr(void);
 void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
+void            lapiccalib(void);
+uint            lapiccount(void);
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
 void            lapicstartap(uchar, uint);
+void            lapictimer(uint);
+extern uint     ticr;
 void            microdelay(int);
+void            nanotime(struct timespec*);
 
 // log.c
 void            initlog(int dev);
@@ -91,39 +133,109 @@ void            end_op();
 extern int      ismp;
 void            mpinit(void);
 
+// pcache.c
+int             pccopy(struct inode*, uint, char*, uint, int);
+void            pcdrop(struct inode*);
+char*           pcget(struct inode*, uint, uint);
+void            pcinit(void);
+int             pcput(struct inode*, uint, uint, int (*)(void*, char*, int), void*);
+void            pctrim(struct inode*);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
 
 // pipe.c
-int             pipealloc(struct file**, struct file**);
+int             pipealloc(struct file**, struct file**, int);
 void            pipeclose(struct pipe*, int);
+int             pipeput(struct pipe*, char*, int);
 int             piperead(struct pipe*, char*, int);
+int             pipewait(struct pipe*);
 int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
 // proc.c
+int             clone(uint, uint, uint);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+int             getpriority(int);
+int             join(int);
 int             kill(int);
+void            kproc(char*, void (*)(void));
+void            mmlock(pde_t*);
+void            mmunlock(pde_t*);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
+int             nice(int);
+void            pinclear(void);
 void            pinit(void);
+void            pinwait(uint, uint);
+void            prioboost(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             schedtick(void);
 void            setproc(struct proc*);
+int             swapout(void);
+pde_t*          switchmm(pde_t*, uint, struct vma*, struct vma*);
 void            sleep(void*, struct spinlock*);
+void            unpin(void);
 void            userinit(void);
+int             vmshared(struct proc*);
+void            vmsync(struct proc*);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 
+// rcu.c
+void            rcuinit(void);
+void            rcureadlock(void);
+void            rcureadunlock(void);
+void            rcuquiesce(void);
+void            rcuidle(void);
+void            callrcu(struct rcuhead*, void (*)(void*), void*);
+int             rcupending(void);
+void            rcutick(void);
+
+// ring.c
+int             ringenter(int);
+int             ringsetup(uint);
+
+// rwlock.c
+void            initrwlock(struct rwlock*, char*);
+void            acquireread(struct rwlock*);
+void            releaseread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+void            releasewrite(struct rwlock*);
+int             holdingwrite(struct rwlock*);
+void            seqwritebegin(struct seqlock*);
+void            seqwriteend(struct seqlock*);
+uint            seqreadbegin(struct seqlock*);
+int             seqreadretry(struct seqlock*, uint);
+
+// shm.c
+void            shminit(void);
+int             shmattach(char*, int, int);
+void            shmdup(struct shm*);
+void            shmput(struct shm*);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// swap.c
+void            swapinit(void);
+void            swaptick(void);
+int             swapalloc(void);
+void            swapdone(int);
+void            swapfree(int);
+void            swapread(int, char*);
+void            swapwrite(int, char*);
+int             swapwait(void);
+void            kswapd(void);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -132,12 +244,18 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
+struct lockclass* lockclass(char*, int);
+void            lockcount(struct lockclass*, uint, uint64);
+void            lockheld(struct lockclass*, uint64);
+int             getlockstat(uint, int, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            acquiresleepread(struct sleeplock*);
+void            releasesleepread(struct sleeplock*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -151,19 +269,33 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argoutptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
+int             syscallat(int, uint);
 
 // timer.c
+void            clockintr(void);
+void            clockstart(void);
+void            clockstop(void);
+int             ticksleep(int);
+int             timesleep(struct timespec*);
 void            timerinit(void);
+void            timerdel(struct proc*);
+void            timerset(struct proc*, uint);
+void            timertick(uint);
+uint            readticks(void);
 
 // trap.c
+extern int      havesysenter;
 void            idtinit(void);
+void            systrap(struct trapframe*);
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
+extern struct seqlock tickseq;
 
 // uart.c
 void            uartinit(void);
@@ -177,14 +309,27 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+int             shrinkuvm(struct proc*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
+char*           allocpage(void);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+void            dropuvm(void);
+void            flushtlb(void);
+void            tlbshootdown(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             pagefault(uint, uint);
+int             prefault(uint, uint, int);
+int             mmap(struct file*, uint, uint, int, int);
+int             munmap(uint, uint);
+int             mapshm(struct shm*, char**, int);
+int             shmdetach(uint);
+int             vmadup(struct proc*, struct proc*);
+void            vmaput(pde_t*, struct vma*);
+char*           swapscan(struct proc*, uint*, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
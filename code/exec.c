@@ -6,16 +6,22 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "stat.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nvma;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
+  struct vma vma[NVMA], oldvma[NVMA];
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
@@ -26,8 +32,10 @@ exec(char *path, char **argv)
       cprintf("exec: fail\n");
       return -1;
     }
-  ilock(ip);   //对该inode上锁，使得数据有效
+  ilockshared(ip);   //只读，和别的exec同一程序的进程共享着锁，使得数据有效
   pgdir = 0;
+  if(ip->type != T_FILE)   //设备文件的读会放开独占的锁
+    goto bad;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))  //读取elf头
@@ -38,25 +46,40 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)  //建立内核页表
     goto bad;
 
-  // Load program into memory.
+  // Record each loadable segment as a file-backed region.
+  // Nothing is read yet: pagefault() reads a page from ip
+  // the first time the program touches it.
   sz = 0;   //进程大小初始为0
+  nvma = 0;
+  memset(vma, 0, sizeof(vma));
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
       if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))  //读取程序头
         goto bad;
-      if(ph.type != ELF_PROG_LOAD)  //如果是可装载段
+      if(ph.type != ELF_PROG_LOAD || ph.memsz == 0)  //如果是可装载段
         continue;
       if(ph.memsz < ph.filesz)  //memsz不应该小于filesz
         goto bad;
       if(ph.vaddr + ph.memsz < ph.vaddr)  //memsz也不应该是负数
         goto bad;
-      if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)  //分配sz到ph.vaddr + ph.memsz之间的虚拟内存
+      if(ph.vaddr + ph.memsz >= KERNBASE)  //不能映射到内核空间
         goto bad;
       if(ph.vaddr % PGSIZE != 0)  //地址应该是对齐的
         goto bad;
-      if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0) //从磁盘搬运filesz字节的数据到vaddr
+      if(ph.vaddr < sz || nvma >= NVMA)  //段之间不能重叠
         goto bad;
+      vma[nvma].start = ph.vaddr;   //只记录段的位置，不从磁盘搬运数据
+      vma[nvma].end = ph.vaddr + ph.memsz;
+      vma[nvma].ip = ip;
+      vma[nvma].off = ph.off;
+      vma[nvma].filesz = ph.filesz;
+      vma[nvma].perm = PTE_W|PTE_U;
+      nvma++;
+      sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  for(i = 0; i < nvma; i++)   //每个区域各持有一个inode引用，直到进程退出或者再次exec
+    idup(ip);
+  iunlockshared(ip);
+  iput(ip);
   end_op();
   ip = 0;
 
@@ -93,22 +116,27 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
-  // Commit to the user image.
-  oldpgdir = curproc->pgdir;   //旧页目录
-  curproc->pgdir = pgdir;   //换新页目录
-  curproc->sz = sz;    //更改程序大小
+  // Commit to the user image.  Other threads of the old
+  // image keep it.
+  oldpgdir = switchmm(pgdir, sz, vma, oldvma);   //换新页目录、大小和按需调页区域
   curproc->tf->eip = elf.entry;  //设置执行的入口点
   curproc->tf->esp = sp;  //新的用户栈顶
+  curproc->ring = 0;   //旧映像里的提交队列不在了
   switchuvm(curproc);   //切换页表
-  freevm(oldpgdir);   //释放旧的用户空间
+  if(oldpgdir){   //没有线程还在用旧的地址空间
+    vmaput(oldpgdir, oldvma);  //写回旧映射的脏页，放下旧文件的inode
+    freevm(oldpgdir);   //释放旧的用户空间
+  }
   return 0;
 
  bad:    //如果出错，释放已分配的资源
   if(pgdir)
     freevm(pgdir);
   if(ip){
-    iunlockput(ip);
+    iunlockshared(ip);
+    iput(ip);
     end_op();
-  }
+  } else
+    vmaput(0, vma);
   return -1;
 }
@@ -3,3 +3,21 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+
+// lseek() whence
+#define SEEK_SET  0   // From the start of the file
+#define SEEK_CUR  1   // From the current offset
+#define SEEK_END  2   // From the end of the file
+
+// mmap() protection and flags
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+
+#define MAP_SHARED    0x01  // Stores are seen by other mappings and reach the file
+#define MAP_PRIVATE   0x02  // Stores stay in this process
+#define MAP_ANONYMOUS 0x20  // Zero-filled memory, no file
+#define MAP_FAILED    ((void*)-1)
+
+// futex() operations
+#define FUTEX_WAIT    0   // Sleep if *addr == val
+#define FUTEX_WAKE    1   // Wake up to val sleepers on addr
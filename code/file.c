@@ -5,15 +5,21 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "stat.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];   //设备读写函数指针数组
 struct {
   struct spinlock lock;
   struct file file[NFILE];
+  struct files files[NPROC];   //每个进程(或共用的一组线程)一个描述符表
 } ftable;   //文件表，100个槽，即最多打开100个文件
 
 void
@@ -79,14 +85,152 @@ fileclose(struct file *f)   //关闭文件
   }
 }
 
+// A new, empty table of open files.  There are as many tables
+// as processes, so one is always free.
+struct files*
+filesalloc(void)
+{
+  struct files *fs;
+
+  acquire(&ftable.lock);
+  for(fs = ftable.files; fs < ftable.files + NPROC; fs++){
+    if(fs->ref == 0){
+      fs->ref = 1;
+      memset(fs->ofile, 0, sizeof(fs->ofile));
+      release(&ftable.lock);
+      return fs;
+    }
+  }
+  panic("filesalloc");
+}
+
+// Share the table fs with one more process, for clone().
+struct files*
+filesdup(struct files *fs)
+{
+  acquire(&ftable.lock);
+  fs->ref++;
+  release(&ftable.lock);
+  return fs;
+}
+
+// A new table holding the files of fs, for fork().
+struct files*
+filescopy(struct files *fs)
+{
+  struct files *nfs;
+  int fd;
+
+  nfs = filesalloc();
+  acquire(&ftable.lock);
+  for(fd = 0; fd < NOFILE; fd++){
+    if((nfs->ofile[fd] = fs->ofile[fd]) != 0)
+      nfs->ofile[fd]->ref++;
+  }
+  release(&ftable.lock);
+  return nfs;
+}
+
+// Drop a process's use of fs, closing its files if it was the
+// last one.
+void
+filesput(struct files *fs)
+{
+  struct file *ofile[NOFILE];
+  int fd;
+
+  acquire(&ftable.lock);
+  if(--fs->ref > 0){
+    release(&ftable.lock);
+    return;
+  }
+  memmove(ofile, fs->ofile, sizeof(ofile));
+  memset(fs->ofile, 0, sizeof(fs->ofile));
+  release(&ftable.lock);
+  for(fd = 0; fd < NOFILE; fd++)
+    if(ofile[fd])
+      fileclose(ofile[fd]);
+}
+
+// Give f the lowest free descriptor of the current process.
+// Takes over the caller's reference to f on success.
+int
+fdalloc(struct file *f)
+{
+  struct files *fs = myproc()->files;
+  int fd;
+
+  acquire(&ftable.lock);
+  for(fd = 0; fd < NOFILE; fd++){
+    if(fs->ofile[fd] == 0){  //如果该描述符对应的元素为0则空闲可分配
+      fs->ofile[fd] = f;
+      release(&ftable.lock);
+      return fd;
+    }
+  }
+  release(&ftable.lock);
+  return -1;
+}
+
+// The file open as fd in the current process, or 0.  If other
+// threads share the table one of them may close fd at any time,
+// so the current system call gets a reference of its own, which
+// fdput() drops when the call returns.
+struct file*
+fdget(int fd)
+{
+  struct proc *p = myproc();
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&ftable.lock);
+  f = p->files->ofile[fd];
+  if(f && p->files->ref > 1){   //别的线程可能同时close它
+    if(p->nfhold == NFHOLD)
+      panic("fdget");
+    f->ref++;
+    p->fhold[p->nfhold++] = f;
+  }
+  release(&ftable.lock);
+  return f;
+}
+
+// Drop the references fdget() took, down to the first n.
+void
+fdput(int n)
+{
+  struct proc *p = myproc();
+
+  while(p->nfhold > n)
+    fileclose(p->fhold[--p->nfhold]);
+}
+
+// Free descriptor fd of the current process, returning the file
+// it held (whose reference passes to the caller), or 0.
+struct file*
+fdfree(int fd)
+{
+  struct files *fs = myproc()->files;
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&ftable.lock);
+  f = fs->ofile[fd];
+  fs->ofile[fd] = 0;
+  release(&ftable.lock);
+  return f;
+}
+
 // Get metadata about file f.
 int
 filestat(struct file *f, struct stat *st)  //获取inode信息，放进stat结构体
 {
   if(f->type == FD_INODE){  //如果文件类型为“INODE”文件
-    ilock(f->ip);   //取锁
+    ilockshared(f->ip);   //取锁
     stati(f->ip, st);  //获取inode信息，放进stat结构体
-    iunlock(f->ip); //解锁
+    iunlockshared(f->ip); //解锁
     return 0;
   }
   return -1;
@@ -95,19 +239,66 @@ filestat(struct file *f, struct stat *st)  //获取inode信息，放进stat结
 // Read from file f.
 int fileread(struct file *f, char *addr, int n)
 {
-  int r;
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filereadv(f, &iov, 1, -1);
+}
+
+// Read from file f into the cnt buffers of iov in turn, at
+// offset off, or if off is -1 at f->off, advancing it.  The
+// inode is locked once for all of them.  A pipe or device reads
+// into the first non-empty buffer only, since going on to the
+// next could wait.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt, int off)
+{
+  int i, r, n, shared;
+  uint o;
 
   if(f->readable == 0)   //如果该文件不可读
     return -1;
-  if(f->type == FD_PIPE)  //如果该文件是管道
-    return piperead(f->pipe, addr, n);  //调用管道读的方法
-  if(f->type == FD_INODE){  //如果是inode类型的文件
+  if(f->type == FD_PIPE || (f->type == FD_INODE && f->ip->type == T_DEV)){
+    for(i = 0; i < cnt && iov[i].len == 0; i++)
+      ;
+    if(i == cnt)
+      return 0;
+    if(f->type == FD_PIPE)  //如果该文件是管道
+      return off < 0 ? piperead(f->pipe, iov[i].base, iov[i].len) : -1;  //管道没有偏移
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0) //调用readi方法
-      f->off += r;
+    r = readi(f->ip, iov[i].base, 0, iov[i].len);   //设备不管偏移
     iunlock(f->ip);
     return r;
   }
+  if(f->type == FD_INODE){  //如果是inode类型的文件
+    // Readers of the inode may share its lock, unless another
+    // process also reads through f and so moves f->off.
+    shared = off >= 0 || f->ref == 1;
+    if(shared)
+      ilockshared(f->ip);
+    else
+      ilock(f->ip);
+    o = off < 0 ? f->off : off;
+    for(n = i = 0; i < cnt; i++){
+      if((r = readi(f->ip, iov[i].base, o, iov[i].len)) < 0){ //调用readi方法
+        if(n == 0)
+          n = -1;
+        break;
+      }
+      n += r;
+      o += r;
+      if(r < iov[i].len)   //读到文件尾了
+        break;
+    }
+    if(off < 0 && n > 0)
+      f->off = o;
+    if(shared)
+      iunlockshared(f->ip);
+    else
+      iunlock(f->ip);
+    return n;
+  }
   panic("fileread");
 }
 
@@ -116,12 +307,34 @@ int fileread(struct file *f, char *addr, int n)
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
+  struct iovec iov;
+
+  iov.base = addr;
+  iov.len = n;
+  return filewritev(f, &iov, 1, -1);
+}
+
+// Write the cnt buffers of iov in turn to file f, at offset
+// off, or if off is -1 at f->off, advancing it.  Returns -1
+// unless all of them are written.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt, int off)
+{
+  int i, r, n, n1, done, room;
+  uint o;
 
   if(f->writable == 0)
     return -1;
-  if(f->type == FD_PIPE)   //如果是管道文件
-    return pipewrite(f->pipe, addr, n);   //调用写管道的方法
+  if(f->type == FD_PIPE){   //如果是管道文件
+    if(off >= 0)
+      return -1;
+    for(n = i = 0; i < cnt; i++){
+      if(pipewrite(f->pipe, iov[i].base, iov[i].len) != iov[i].len)   //调用写管道的方法
+        return -1;
+      n += iov[i].len;
+    }
+    return n;
+  }
   if(f->type == FD_INODE){ //如果是INODE文件
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
@@ -129,28 +342,143 @@ filewrite(struct file *f, char *addr, int n)
     // and 2 blocks of slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
+    // A transaction goes on from one buffer to the next.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
+    o = off;
+    r = n = i = done = 0;
+    while(i < cnt){
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      if(off < 0)
+        o = f->off;
+      for(room = max; i < cnt && room > 0; room -= r){
+        n1 = iov[i].len - done;
+        if(n1 > room)
+          n1 = room;
+        if((r = writei(f->ip, (char*)iov[i].base + done, o, n1)) < 0)
+          break;
+        if(r != n1)
+          panic("short filewrite");
+        o += r;
+        n += r;
+        done += r;
+        if(done == iov[i].len){   //这个缓冲区写完了，接着写下一个
+          i++;
+          done = 0;
+        }
+      }
+      if(off < 0)
+        f->off = o;
       iunlock(f->ip);
       end_op();
 
       if(r < 0)
         break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
     }
-    return i == n ? n : -1;
+    return i == cnt ? n : -1;
   }
   panic("filewrite");
 }
 
+static int
+putpipe(void *p, char *addr, int n)
+{
+  return pipeput(p, addr, n);
+}
+
+// Move up to n bytes from file in, at in->off, to out, without
+// going through user space, and advance in->off.  For a pipe
+// the bytes go straight from the buffer cache into the pipe,
+// waiting for room with neither the inode nor a block locked,
+// so that the reader can get at the file meanwhile.  Anything
+// else is written from a kernel page, and in->off advances only
+// by what out took.  Returns how many bytes moved, which is less
+// than n only at the end of in or on an error; -1 if there was
+// an error before any moved.
+int
+filesend(struct file *out, struct file *in, int n)
+{
+  int r, w, m, tot, shared, eof;
+  char *page;
+
+  if(in->readable == 0 || in->type != FD_INODE || in->ip->type == T_DEV ||
+     out->writable == 0 || n < 0)
+    return -1;
+  page = 0;
+  if(out->type != FD_PIPE && (page = kalloc()) == 0)
+    return -1;
+  shared = in->ref == 1;   //同fileread
+  r = 0;
+  for(tot = 0; tot < n; tot += r){
+    m = n - tot;
+    if(out->type == FD_PIPE){
+      if((r = pipewait(out->pipe)) < 0)   //等有空位时不持有任何锁
+        break;
+      if(m > r)
+        m = r;
+    } else if(m > PGSIZE)
+      m = PGSIZE;
+    if(shared)
+      ilockshared(in->ip);
+    else
+      ilock(in->ip);
+    if(out->type == FD_PIPE){
+      r = readiput(in->ip, in->off, m, putpipe, out->pipe);
+      if(r > 0)
+        in->off += r;
+    } else
+      r = readi(in->ip, page, in->off, m);
+    eof = in->off >= in->ip->size;
+    if(shared)
+      iunlockshared(in->ip);
+    else
+      iunlock(in->ip);
+    if(r > 0 && page){
+      w = filewrite(out, page, r);
+      if(w > 0){   //只前进写出去的部分
+        ilock(in->ip);
+        in->off += w;
+        iunlock(in->ip);
+      }
+      if(w != r){
+        if(w > 0)
+          tot += w;
+        r = -1;
+      }
+    }
+    if(r < 0 || (r == 0 && eof))   //出错了，或者文件读完了
+      break;
+    // r == 0 short of the end: another writer filled the pipe
+    // after pipewait(); wait for room again.
+  }
+  if(page)
+    kfree(page);
+  return tot > 0 || r >= 0 ? tot : -1;
+}
+
+// Set f->off to off bytes from the start of the file, from
+// f->off or from the end, as whence is SEEK_SET, SEEK_CUR or
+// SEEK_END.  Files have no holes, so it may not go past the
+// end.  Returns the new offset.
+int
+fileseek(struct file *f, int off, int whence)
+{
+  int r;
+
+  if(f->type != FD_INODE || f->ip->type == T_DEV)
+    return -1;
+  ilock(f->ip);
+  if(whence == SEEK_CUR)
+    off += f->off;
+  else if(whence == SEEK_END)
+    off += f->ip->size;
+  else if(whence != SEEK_SET)
+    off = -1;
+  if(off >= 0 && off <= f->ip->size)
+    r = f->off = off;
+  else
+    r = -1;
+  iunlock(f->ip);
+  return r;
+}
+
@@ -1,3 +1,10 @@
+// Table of a process's open files, indexed by descriptor.
+// Threads made by clone() share their creator's.
+struct files {
+  int ref;            // Processes using it 共用它的进程数
+  struct file *ofile[NOFILE];  //打开文件描述符表
+};
+
 struct file {
   enum { FD_NONE, FD_PIPE, FD_INODE } type;  //文件类型
   int ref; // reference count  //引用数
@@ -23,6 +30,7 @@ struct inode {
   short nlink;        //硬链接数
   uint size;          //文件大小
   uint addrs[NDIRECT+1];   //数据块索引
+  int nmap;           // Pages in the page cache (pcache.c) 在页缓存中的页数
 };
 
 // table mapping major device number to
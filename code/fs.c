@@ -14,6 +14,7 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
+#include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
@@ -151,13 +152,21 @@ static void bfree(int dev, uint b) //释放一个数据块，相应位图清零
 // multi-step atomic operations.
 //
 // The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// entries: ip->ref indicates whether an entry is free, and
+// ip->dev and ip->inum indicate which i-node an entry holds.
+// Lookups take no lock.  Entries are never freed, only reused,
+// so iget() may look at one while it changes hands: it takes a
+// reference with an atomic add, which fails on a free entry,
+// and then checks that the entry still holds the i-node it
+// wants.  ip->ref only changes by atomic adds, and only goes
+// from 0 to 1 under icache.lock.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+// Code that only reads an inode may hold ip->lock shared, with
+// ilockshared(), so that processes reading one file or looking
+// up names in one directory do not wait for each other.
 
 struct {
   struct spinlock lock;
@@ -232,17 +241,40 @@ void iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
+// Take a reference to ip, unless it is free.
+static int
+irefget(struct inode *ip)
+{
+  uint ref;
+
+  do{
+    ref = ip->ref;
+    if(ref == 0)
+      return 0;
+  } while(cmpxchg((uint*)&ip->ref, ref, ref+1) != ref);
+  return 1;
+}
+
 static struct inode* iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
 
-  acquire(&icache.lock);
-
   // Is the inode already cached? 如果该dinode在内存中已缓存
+  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum && irefget(ip)){
+      if(ip->dev == dev && ip->inum == inum)    //拿到引用后它还是这个i结点
+        return ip;
+      iput(ip);   //刚被换成了别的i结点，放下这个引用
+    }
+  }
+
+  // Look again while allocating, in case another process
+  // cached it meanwhile.
+  acquire(&icache.lock);
   empty = 0;
   for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){    //在缓存中找到该i结点
-      ip->ref++;                   //引用加1
+    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+      xadd((uint*)&ip->ref, 1);
       release(&icache.lock);
       return ip;
     }
@@ -258,8 +290,11 @@ static struct inode* iget(uint dev, uint inum)
   ip = empty;
   ip->dev = dev;
   ip->inum = inum;
-  ip->ref = 1;
   ip->valid = 0;
+  if(ip->nmap)   //页缓存按inode指针找页，不能让新文件看到旧文件的页
+    pcdrop(ip);
+  __sync_synchronize();   //先填好再让无锁的查找看到它
+  ip->ref = 1;
   release(&icache.lock);
 
   return ip;
@@ -269,9 +304,7 @@ static struct inode* iget(uint dev, uint inum)
 // Returns ip to enable ip = idup(ip1) idiom.
 struct inode* idup(struct inode *ip) //i结点引用加1
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  xadd((uint*)&ip->ref, 1);
   return ip;
 }
 
@@ -303,6 +336,35 @@ void ilock(struct inode *ip)
   }
 }
 
+// Lock the given inode shared with other readers, who may
+// not change it.  Reads the inode from disk if necessary.
+// Like ilock(), it must not be called with ip already locked,
+// even shared (see sleeplock.c).
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepread(&ip->lock);
+  if(ip->valid == 0){   //还没读进来，先独占着读，我们持有引用，读完就一直有效
+    releasesleepread(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepread(&ip->lock);
+  }
+}
+
+// Unlock an inode locked with ilockshared().
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepread(&ip->lock);
+}
+
 // Unlock the given inode.
 void iunlock(struct inode *ip)
 {
@@ -324,9 +386,7 @@ void iput(struct inode *ip)
   acquiresleep(&ip->lock);      //取锁
   if(ip->valid && ip->nlink == 0){   
     //获取该i结点的引用数
-    acquire(&icache.lock);
     int r = ip->ref;
-    release(&icache.lock);
 
     if(r == 1){   //引用数链接数都为0时，删除文件
       // inode has no links and no other references: truncate and free.
@@ -336,11 +396,13 @@ void iput(struct inode *ip)
       ip->valid = 0;
     }
   }
+  // Decide on the page cache with the decrement itself: two
+  // iput()s that each looked at ref first could both see 2.
+  // The slot cannot be reused by another inode's readi()
+  // until the lock is released.
+  if(xadd((uint*)&ip->ref, -1) == 1 && ip->nmap)   //最后一个引用，页缓存里它的页不会再有人找了
+    pcdrop(ip);
   releasesleep(&ip->lock);
-
-  acquire(&icache.lock);
-  ip->ref--;    //一般情况下引用数减一
-  release(&icache.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -460,14 +522,54 @@ int readi(struct inode *ip, char *dst, uint off, uint n) //从inode读取数据
     n = ip->size - off;    //则只能够再读取这么多字节
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){  //tol:目前总共已读的字节数，n:需要读取的字节数,off:从这开始读,dst:目的地
-    bp = bread(ip->dev, bmap(ip, off/BSIZE)); //读取off所在的数据块到缓存块
     m = min(n - tot, BSIZE - off%BSIZE);  //一次性最多读取m字节
+    if(ip->nmap && pccopy(ip, off, dst, m, 0))   //被共享映射的页以页缓存为准
+      continue;
+    bp = bread(ip->dev, bmap(ip, off/BSIZE)); //读取off所在的数据块到缓存块
     memmove(dst, bp->data + off%BSIZE, m);  //复制数据到dst
     brelse(bp);  //释放缓存块
   }
   return n;
 }
 
+// Hand the data of ip from off on, up to n bytes, to put(arg,
+// data, m) a piece at a time, straight from the buffer cache
+// (or the page cache, for pages mapped MAP_SHARED), for as
+// long as put takes all of each piece.  put runs with the block
+// locked and must not sleep.  Returns how many bytes put took.
+// Caller must hold ip->lock.
+int
+readiput(struct inode *ip, uint off, uint n, int (*put)(void*, char*, int), void *arg)
+{
+  uint tot, m;
+  int r;
+  struct buf *bp;
+
+  if(ip->type == T_DEV || off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=r, off+=r){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(ip->nmap && (r = pcput(ip, off, m, put, arg)) >= 0){
+      if(r < (int)m){
+        tot += r;
+        break;
+      }
+      continue;
+    }
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    r = put(arg, (char*)bp->data + off%BSIZE, m);   //不经过用户空间
+    brelse(bp);
+    if(r < (int)m){
+      tot += r;
+      break;
+    }
+  }
+  return tot;
+}
+
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
@@ -493,6 +595,8 @@ writei(struct inode *ip, char *src, uint off, uint n) //通过inode写数据
     bp = bread(ip->dev, bmap(ip, off/BSIZE));  //读取off所在的数据块到缓存块
     m = min(n - tot, BSIZE - off%BSIZE);       //一次性最多读取m字节
     memmove(bp->data + off%BSIZE, src, m);     //复制数据到dst
+    if(ip->nmap)
+      pccopy(ip, off, src, m, 1);   //共享映射看到的页也要更新
     log_write(bp);    //写到日志块
     brelse(bp);       //释放该块
   }
@@ -624,21 +728,22 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);       //读取当前工作目录
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);   //给inode ip 上锁，使得inode 数据有效
+    ilockshared(ip);   //只读目录，和别的查找者共享着锁，使得inode 数据有效
     if(ip->type != T_DIR){   //如果不是目录文件
-      iunlockput(ip);   //释放锁，释放inode ip
+      iunlockshared(ip);   //释放锁，释放inode ip
+      iput(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){    //如果是要返回父结点，并且剩下的路径已经为空，则当前结点就是父结点直接返回
       // Stop one level early.
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){   //查询下一层目录，若无
-      iunlockput(ip);
+    next = dirlookup(ip, name, 0);   //查询下一层目录
+    iunlockshared(ip);
+    iput(ip);
+    if(next == 0)
       return 0;
-    }
-    iunlockput(ip);
     ip = next;    //当前目录指向下一层，然后while循环，直到解析到最后
   }
   if(nameiparent){
@@ -19,6 +19,8 @@ struct superblock {
   uint logstart;     // Block number of first log block  //第一个日志块块号 
   uint inodestart;   // Block number of first inode block  //第一个i结点所在块号
   uint bmapstart;    // Block number of first free map block  //第一个位图块块号
+  uint swapstart;    // Block number of first swap block  //交换区起始块号
+  uint nswap;        // Number of swap blocks  //交换区块数
 };
 
 #define NDIRECT 12
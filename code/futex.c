@@ -0,0 +1,87 @@
+//
+// Futexes: sleeping on a word of user memory.
+//
+// futex(addr, FUTEX_WAIT, val) sleeps if the int at addr still
+// holds val; futex(addr, FUTEX_WAKE, n) wakes up to n of the
+// processes sleeping on addr.  Sleepers are keyed by the kernel
+// address of the word, i.e. by its physical address, so threads
+// and processes that map the same page (MAP_SHARED mappings, shm
+// segments) meet on it wherever each has it mapped.
+//
+// FUTEX_WAIT checks the word and goes to sleep under the lock
+// that FUTEX_WAKE takes for the same word, so a store followed by
+// a wake from another process cannot slip in between.  Pages of
+// shared mappings are never swapped out, nor are those of a
+// process in a system call, so the key stays put while a process
+// sleeps on it.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "fcntl.h"
+
+#define NFUTEXLOCK 16
+#define FUTEXLOCK(ka) (&futexlock[((uint)(ka) >> 2) % NFUTEXLOCK])
+
+static struct spinlock futexlock[NFUTEXLOCK];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXLOCK; i++)
+    initlock(&futexlock[i], "futex");
+}
+
+// Kernel address of the int at user address addr, faulting its
+// page in first.  Returns 0 if addr is unaligned or not mapped.
+static int*
+futexaddr(uint addr)
+{
+  char *ka;
+
+  if(addr % sizeof(int) || prefault(addr, sizeof(int), 0) < 0)
+    return 0;
+  if((ka = uva2ka(myproc()->pgdir, (char*)addr)) == 0)   //别的线程刚把它解除了映射
+    return 0;
+  return (int*)(ka + addr % PGSIZE);
+}
+
+// Wait on or wake the word at addr.  FUTEX_WAIT returns 0 once
+// woken, -1 at once if the word does not hold val or if the
+// process is killed.  FUTEX_WAKE returns how many it woke.
+int
+futex(uint addr, int op, int val)
+{
+  struct spinlock *lk;
+  int *ka, n;
+
+  if((ka = futexaddr(addr)) == 0)
+    return -1;
+  lk = FUTEXLOCK(ka);
+  switch(op){
+  case FUTEX_WAIT:
+    acquire(lk);
+    if(*ka != val || myproc()->killed){   //已经变了，不用睡
+      release(lk);
+      return -1;
+    }
+    sleep(ka, lk);
+    n = myproc()->killed ? -1 : 0;
+    release(lk);
+    return n;
+  case FUTEX_WAKE:
+    if(val <= 0)
+      return 0;
+    acquire(lk);
+    n = wakeupn(ka, val);
+    release(lk);
+    return n;
+  }
+  return -1;
+}
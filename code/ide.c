@@ -75,7 +75,7 @@ static void idestart(struct buf *b)
 {
   if(b == 0)   
     panic("idestart");
-  if(b->blockno >= FSSIZE)   //块号超过了文件系统支持的块数
+  if(b->blockno >= FSSIZE+SWAPSIZE)   //块号超过了文件系统支持的块数
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;   //每块的扇区数
   int sector = b->blockno * sector_per_block;   //扇区数
@@ -1,6 +1,7 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and 4MB
+// superpages for large user heaps.
 
 #include "types.h"
 #include "defs.h"
@@ -21,6 +22,13 @@ struct {
   struct spinlock lock;   //自旋锁
   int use_lock;           //现下是否使用锁？
   struct run *freelist;   //空闲链表头
+  struct run *superlist;  //空闲4MB大页链表头
+  int nfree;              //freelist中的页数
+  int nsuper;             //superlist中的大页数
+  // Number of page tables mapping each physical page, so
+  // that a page shared between address spaces (MAP_SHARED)
+  // is only freed by the last kfree().
+  ushort ref[PHYSTOP/PGSIZE];
 } kmem;
 
 // Initialization happens in two phases.
@@ -36,9 +44,19 @@ void kinit1(void *vstart, void *vend)    //kinit1(end, P2V(4*1024*1024));
   freerange(vstart, vend);
 }
 
+// The top NSUPERPG 4MB-aligned chunks of memory are kept
+// whole on their own list for ksuperalloc(); kalloc() breaks
+// one up only when the ordinary pages run out.
 void kinit2(void *vstart, void *vend)   //kinit2(P2V(4*1024*1024), P2V(PHYSTOP));
 {
-  freerange(vstart, vend);
+  char *p;
+
+  p = (char*)((uint)vend & ~(SUPERPGSIZE-1));
+  while(p - SUPERPGSIZE >= (char*)vstart && p > (char*)vend - NSUPERPG*SUPERPGSIZE){
+    p -= SUPERPGSIZE;
+    ksuperfree(p);
+  }
+  freerange(vstart, p);
   kmem.use_lock = 1;
 }
 
@@ -61,6 +79,18 @@ void kfree(char *v)   //释放页v
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP) 
     panic("kfree");
 
+  if(kmem.use_lock)        //如果使用了锁，取锁
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] > 1){   //还有别的页表映射着这一页，只减引用
+    kmem.ref[V2P(v)/PGSIZE]--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  kmem.ref[V2P(v)/PGSIZE] = 0;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);  //将这个页填充无用信息，全置为1
 
@@ -69,6 +99,7 @@ void kfree(char *v)   //释放页v
   r = (struct run*)v;       //头插法将这个页放在链头
   r->next = kmem.freelist;  //当前页指向链头
   kmem.freelist = r;        //链头移到当前页
+  kmem.nfree++;
   if(kmem.use_lock)         //如果使用了锁，解锁
     release(&kmem.lock);
 }
@@ -79,14 +110,142 @@ void kfree(char *v)   //释放页v
 char* kalloc(void)
 {
   struct run *r;       //声明run结构体指针
+  int i;
 
   if(kmem.use_lock)    //如果使用了锁，取锁
     acquire(&kmem.lock);
+  if(kmem.freelist == 0 && kmem.superlist){   //小页用完了，拆一个大页
+    r = kmem.superlist;
+    kmem.superlist = r->next;
+    kmem.nsuper--;
+    kmem.nfree += NPTENTRIES;
+    for(i = 0; i < NPTENTRIES; i++){
+      ((struct run*)((char*)r + i*PGSIZE))->next = kmem.freelist;
+      kmem.freelist = (struct run*)((char*)r + i*PGSIZE);
+    }
+  }
   r = kmem.freelist;      //第一个空闲页地址赋给r
-  if(r)
+  if(r){
     kmem.freelist = r->next;  //链头移动到下一页，相当于把链头给分配出去了
+    kmem.nfree--;
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+  }
   if(kmem.use_lock)    //如果使用了锁，解锁
     release(&kmem.lock);
   return (char*)r;    //返回第一个空闲页的地址
 }
 
+// Record one more page table mapping the page at v,
+// which must have come from kalloc().  Each mapping
+// drops its reference with kfree().
+void
+kdup(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kdup");
+
+  acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] < 1)
+    panic("kdup: free page");
+  kmem.ref[V2P(v)/PGSIZE]++;
+  release(&kmem.lock);
+}
+
+// Allocate one 4MB, 4MB-aligned superpage for a large user
+// heap.  Returns 0 if none is left: the caller falls back to
+// ordinary pages.
+char*
+ksuperalloc(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  r = kmem.superlist;
+  if(r){
+    kmem.superlist = r->next;
+    kmem.nsuper--;
+  }
+  release(&kmem.lock);
+  return (char*)r;
+}
+
+// Free a superpage returned by ksuperalloc() (or, during
+// kinit2, set one aside).
+void
+ksuperfree(char *v)
+{
+  struct run *r;
+
+  if((uint)v % SUPERPGSIZE || v < end || V2P(v) + SUPERPGSIZE > PHYSTOP)
+    panic("ksuperfree");
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  r = (struct run*)v;
+  r->next = kmem.superlist;
+  kmem.superlist = r;
+  kmem.nsuper++;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
+
+// Turn the superpage at v into NPTENTRIES ordinary pages,
+// each of which is then freed on its own with kfree().
+void
+ksplit(char *v)
+{
+  int i;
+
+  if((uint)v % SUPERPGSIZE || v < end || V2P(v) + SUPERPGSIZE > PHYSTOP)
+    panic("ksplit");
+
+  acquire(&kmem.lock);
+  for(i = 0; i < NPTENTRIES; i++)
+    kmem.ref[V2P(v)/PGSIZE + i] = 1;
+  release(&kmem.lock);
+}
+
+// Drop one reference to the page at v, as kfree() does, but
+// keep the page even if that was the last one.  Returns the
+// references left; the caller that sees 0 frees the page.
+int
+kunref(char *v)
+{
+  int n;
+
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kunref");
+
+  acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] < 1)
+    panic("kunref: free page");
+  n = --kmem.ref[V2P(v)/PGSIZE];
+  release(&kmem.lock);
+  return n;
+}
+
+// Number of page tables, and caches, holding the page at v.
+int
+kref(char *v)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.ref[V2P(v)/PGSIZE];
+  release(&kmem.lock);
+  return n;
+}
+
+// Number of free pages, counting those in free superpages,
+// which kalloc() breaks up when it has to.  Used by kswapd
+// to decide when to swap.
+int
+kfreecount(void)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.nfree + kmem.nsuper*NPTENTRIES;
+  release(&kmem.lock);
+  return n;
+}
@@ -34,6 +34,7 @@
 #define ICRHI   (0x0310/4)   // Interrupt Command [63:32]
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
   #define X1         0x0000000B   // divide counts by 1
+  #define ONESHOT    0x00000000   // One-shot
   #define PERIODIC   0x00020000   // Periodic
 #define PCINT   (0x0340/4)   // Performance Counter LVT
 #define LINT0   (0x0350/4)   // Local Vector Table 1 (LINT0)
@@ -45,6 +46,9 @@
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
 volatile uint *lapic;  // Initialized in mp.c
+uint ticr = 10000000;  // Timer counts per clock tick
+static uint tsckhz;    // TSC cycles per millisecond, 0 if unknown
+static uint64 tsc0;    // TSC at boot
 
 //PAGEBREAK!
 static void lapicw(int index, int value)   //向下标为index的寄存器写value
@@ -62,13 +66,12 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));  //使能APIC
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down at bus frequency from lapic[TICR]
+  // and then issues an interrupt, once: timer.c arms it again
+  // for each tick, or for longer when the CPU is idle.
+  // lapiccalib() sets ticr for HZ ticks a second.
   lapicw(TDCR, X1);   //设置分频系数
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));  //设置Timer的模式和中断向量号
-  lapicw(TICR, 10000000);  //设置周期性计数的数字
+  lapicw(TIMER, ONESHOT | (T_IRQ0 + IRQ_TIMER));  //设置Timer的模式和中断向量号，由timerinit启动
 
   // Disable logical interrupt lines. 屏蔽LINT0 LINT1中断
   lapicw(LINT0, MASKED);
@@ -116,6 +119,109 @@ lapiceoi(void)
     lapicw(EOI, 0); //向EOI写0表中断结束
 }
 
+// Arm this CPU's timer to interrupt after count bus cycles,
+// or stop it if count is 0.
+void
+lapictimer(uint count)
+{
+  if(lapic)
+    lapicw(TICR, count);
+}
+
+// Bus cycles left before this CPU's timer interrupts,
+// 0 if it has or is stopped.
+uint
+lapiccount(void)
+{
+  if(!lapic)
+    return 0;
+  return lapic[TCCR];
+}
+
+// Send interrupt vector to the CPU with LAPIC ID apicid.
+// Caller must have interrupts disabled.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
+// Divide n by d, leaving the remainder in *rem.  The kernel has
+// no libgcc for 64-bit division, so do it with two divl's.
+static uint64
+div64(uint64 n, uint d, uint *rem)
+{
+  uint hi, lo, r;
+
+  hi = (uint)(n >> 32) / d;
+  r = (uint)(n >> 32) % d;
+  asm("divl %4" : "=a" (lo), "=d" (r) : "a" ((uint)n), "d" (r), "rm" (d));
+  *rem = r;
+  return ((uint64)hi << 32) | lo;
+}
+
+#define PIT_HZ    1193182   // 8254 PIT input clock
+#define PIT_CH2   0x42      // Channel 2 counter
+#define PIT_CMD   0x43      // Mode/command register
+#define PIT_GATE  0x61      // Bit 0: channel 2 gate; bit 5: its output
+#define CALIBMS   50        // Length of the calibration run
+
+// Count the LAPIC timer and the TSC over CALIBMS milliseconds
+// timed by PIT channel 2, whose clock rate is fixed, and set
+// ticr for HZ ticks a second.  Called once, by the boot CPU;
+// the others share its bus clock and (we assume) TSC rate.
+void
+lapiccalib(void)
+{
+  uint count, n;
+  uint64 t;
+
+  count = PIT_HZ * CALIBMS / 1000;
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);  //打开通道2的门，关掉扬声器
+  outb(PIT_CMD, 0xB0);     // channel 2, low then high byte, mode 0
+  outb(PIT_CH2, count & 0xFF);
+  outb(PIT_CH2, count >> 8);   //写入高字节后开始倒数
+  if(lapic)
+    lapicw(TICR, 0xFFFFFFFF);
+  t = rdtsc();
+  while((inb(PIT_GATE) & 0x20) == 0)   //倒数到0时输出变高
+    ;
+  t = rdtsc() - t;
+  tsc0 = rdtsc();
+  tsckhz = div64(t, CALIBMS, &n);
+  if(lapic){
+    n = 0xFFFFFFFF - lapic[TCCR];
+    lapicw(TICR, 0);
+    if(n / (CALIBMS * HZ / 1000) > 0)
+      ticr = n / (CALIBMS * HZ / 1000);
+  }
+}
+
+// Time since boot, to the nanosecond from the TSC if
+// lapiccalib() could time it, else at tick resolution.
+void
+nanotime(struct timespec *ts)
+{
+  uint64 ms;
+  uint r, ns, t;
+
+  if(tsckhz == 0){
+    t = readticks();
+    ts->sec = t / HZ;
+    ts->nsec = t % HZ * (1000000000 / HZ);
+    return;
+  }
+  ms = div64(rdtsc() - tsc0, tsckhz, &r);
+  ns = div64((uint64)r * 1000000, tsckhz, &r);   //不足一毫秒的部分
+  ts->sec = div64(ms, 1000, &r);
+  ts->nsec = r * 1000000 + ns;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -0,0 +1,73 @@
+// Spinlock benchmark.  A number of processes each dup() and
+// close() a file descriptor over and over, so that the CPUs
+// fight over ftable.lock, which both take.  Run it with many
+// CPUs (make CPUS=8) and TICKETLOCK set one way or the other
+// in param.h to compare the locks; the spread between the
+// fastest and the slowest process shows how fair they are.
+//
+// usage: lockbench [procs] [rounds]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, n, i, j, fd, pid, fds[2], start, elapsed, t, fast, slow;
+
+  nproc = 4;
+  n = 20000;
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    n = atoi(argv[2]);
+  if(nproc <= 0 || n <= 0 || pipe(fds) < 0){
+    printf(2, "usage: lockbench [procs] [rounds]\n");
+    exit();
+  }
+
+  start = uptime();
+  for(i = 0; i < nproc; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(2, "lockbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(fds[0]);
+      for(j = 0; j < n; j++){
+        if((fd = dup(1)) < 0){
+          printf(2, "lockbench: dup failed\n");
+          break;
+        }
+        close(fd);
+      }
+      t = uptime() - start;
+      write(fds[1], &t, sizeof(t));
+      exit();
+    }
+  }
+  close(fds[1]);
+
+  fast = slow = -1;
+  while(read(fds[0], &t, sizeof(t)) == sizeof(t)){
+    if(fast < 0 || t < fast)
+      fast = t;
+    if(t > slow)
+      slow = t;
+  }
+  for(i = 0; i < nproc; i++)
+    wait();
+  elapsed = uptime() - start;
+
+  // A tick is 10ms.
+  printf(1, "lockbench: %d procs, %d lock pairs each, in %d ticks",
+         nproc, n, elapsed);
+  if(elapsed > 0 && nproc*n >= 1000)
+    printf(1, ", %d ns per pair", elapsed * 10000 / (nproc*n/1000));
+  printf(1, "\n");
+  printf(1, "lockbench: first process done after %d ticks, last after %d\n",
+         fast, slow);
+  exit();
+}
@@ -0,0 +1,57 @@
+// Print the lock contention statistics, the locks that were
+// waited for longest first.  Times are in units of 1024 TSC
+// cycles; the callers are kernel addresses to look up in
+// kernel.asm.  With -r the statistics start over afterwards.
+//
+// usage: lockstat [-r]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "lockstat.h"
+
+struct lockstat ls[NLOCKCLASS];
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat t;
+  int n, i, j, reset;
+
+  reset = 0;
+  if(argc > 1){
+    if(strcmp(argv[1], "-r") != 0){
+      printf(2, "usage: lockstat [-r]\n");
+      exit();
+    }
+    reset = 1;
+  }
+  if((n = getlockstat(ls, NLOCKCLASS, reset)) < 0){
+    printf(2, "lockstat: getlockstat failed\n");
+    exit();
+  }
+
+  for(i = 1; i < n; i++){   //按等待时间从长到短排
+    t = ls[i];
+    for(j = i; j > 0 && ls[j-1].wait < t.wait; j--)
+      ls[j] = ls[j-1];
+    ls[j] = t;
+  }
+
+  printf(1, "name            kind   acquired  contended  wait(kc)  maxhold(kc)\n");
+  for(i = 0; i < n; i++){
+    if(ls[i].nacquire == 0)
+      continue;
+    printf(1, "%s", ls[i].name);
+    for(j = strlen(ls[i].name); j < 16; j++)
+      printf(1, " ");
+    printf(1, "%s  %d  %d  %d  %d\n", ls[i].sleep ? "sleep" : "spin ",
+           ls[i].nacquire, ls[i].ncontend,
+           (uint)(ls[i].wait >> 10), (uint)(ls[i].maxhold >> 10));
+    for(j = 0; j < NLOCKPC; j++)
+      if(ls[i].npc[j])
+        printf(1, "    waited at 0x%x %d times\n", ls[i].pc[j], ls[i].npc[j]);
+  }
+  exit();
+}
@@ -0,0 +1,14 @@
+// Contention statistics for a kind of lock, from getlockstat().
+// Locks initialized with the same name are counted together.
+#define NLOCKPC 4        // callers kept per kind of lock
+
+struct lockstat {
+  char name[16];         //锁的名字
+  int sleep;             // 1 for a sleep lock, 0 for a spinlock
+  uint nacquire;         //取锁次数
+  uint ncontend;         //取锁时锁已被别人持有的次数
+  uint64 wait;           // TSC cycles spent waiting for it
+  uint64 maxhold;        // Longest it was held, in TSC cycles
+  uint pc[NLOCKPC];      // Callers that most often had to wait
+  uint npc[NLOCKPC];     // How often each of them did
+};
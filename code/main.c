@@ -21,19 +21,26 @@ main(void)
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
+  lapiccalib();    // time the LAPIC timer and TSC
   seginit();       // segment descriptors
   picinit();       // disable pic
   ioapicinit();    // another interrupt controller
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  rcuinit();       // read-copy update
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  shminit();       // shared memory segments
+  futexinit();     // futex locks
+  pcinit();        // page cache for shared file mappings
+  swapinit();      // swap area
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
   userinit();      // first user process
+  kproc("kswapd", kswapd);  // page-out daemon
   mpmain();        // finish this processor's setup
 }
 
@@ -51,6 +58,7 @@ static void mpmain(void)
 {
   cprintf("cpu%d: starting %d\n", cpuid(), cpuid());
   idtinit();       // 加载IDT
+  timerinit();     // start this CPU's clock
   xchg(&(mycpu()->started), 1); // 将started置1表启动完成了
   scheduler();     // 开始调度进程执行程序了
 }
@@ -18,7 +18,7 @@
 #define NINODES 200
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ boot block | sb block | log | inode blocks | free bit map | data blocks | swap ]
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
@@ -103,6 +103,8 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);  //日志区起始位置
   sb.inodestart = xint(2+nlog);  //inode区起始位置
   sb.bmapstart = xint(2+nlog+ninodeblocks);  //位图区起始位置
+  sb.swapstart = xint(FSSIZE);  //交换区紧跟在文件系统之后
+  sb.nswap = xint(SWAPSIZE);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -111,6 +113,7 @@ main(int argc, char *argv[])
 
   for(i = 0; i < FSSIZE; i++)  //磁盘清零
     wsect(i, zeroes);
+  wsect(FSSIZE+SWAPSIZE-1, zeroes);  //交换区内容无需清零，只需把镜像扩展到足够大
 
   memset(buf, 0, sizeof(buf));   //buf清0
   memmove(buf, &sb, sizeof(sb)); //移动超级块信息到buf
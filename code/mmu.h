@@ -10,8 +10,18 @@
 #define CR0_PG          0x80000000      // Paging
 
 #define CR4_PSE         0x00000010      // Page size extension PSE=1，允许每页大小为4M，PSE=0，允许每页大小为4K
+#define CR4_PGE         0x00000080      // Page global enable 置1后PTE_G的页在重新加载CR3时不被刷出TLB
+
+// CPUID leaf 1 %edx feature flags
+#define CPUID_SEP       0x00000800      // SYSENTER and SYSEXIT
+
+// Model-specific registers
+#define MSR_SYSENTER_CS  0x174          // Code segment SYSENTER loads; stack and user segments follow it
+#define MSR_SYSENTER_ESP 0x175          // Stack pointer SYSENTER loads
+#define MSR_SYSENTER_EIP 0x176          // Where SYSENTER jumps
 
 // various segment selectors.  
+// SYSENTER and SYSEXIT rely on the first four coming in this order.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
 #define SEG_UCODE 3  // user code
@@ -83,6 +93,7 @@ struct segdesc {
 #define NPDENTRIES      1024    // # directory entries per page directory
 #define NPTENTRIES      1024    // # PTEs per page table
 #define PGSIZE          4096    // bytes mapped by a page
+#define SUPERPGSIZE     (PGSIZE*NPTENTRIES)  // bytes mapped by a PTE_PS directory entry
 
 #define PTXSHIFT        12      // offset of PTX in a linear address
 #define PDXSHIFT        22      // offset of PDX in a linear address
@@ -94,7 +105,16 @@ struct segdesc {
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_G           0x100   // Global
+#define PTE_SWAP        0x200   // Not present: page is in swap slot PTE_ADDR(pte)>>PTXSHIFT
+
+// Page fault error code bits, pushed by the CPU as tf->err on T_PGFLT.
+#define FEC_PR          0x001   // Fault caused by protection violation (page present)
+#define FEC_WR          0x002   // Fault caused by a write
+#define FEC_U           0x004   // Fault occurred in user mode
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)   //页表项的高20位，物理页/一级页表的地址
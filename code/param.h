@@ -1,8 +1,24 @@
 #define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define NPRIO         4  // scheduling levels
+#define NICEMAX      19  // largest nice value
+#define BOOSTTICKS  100  // ticks between priority boosts
+#define HZ          100  // clock ticks per second
+#define TICKETLOCK    1  // spinlocks hand out tickets in FIFO order (0: test-and-set)
+#define LOCKSTAT      1  // count lock contention for getlockstat() (0 disables)
+#define NLOCKCLASS   32  // lock names that getlockstat() keeps apart
 #define NOFILE       16  // open files per process
+#define NVMA         16  // demand-paged memory regions per process
+#define NSUPERPG      8  // 4MB pages set aside for large user heaps (0 disables)
 #define NFILE       100  // open files per system
+#define NFHOLD        4  // files one system call may look up with fdget()
+#define PIPEPAGES     4  // pages in a pipe's buffer unless mkpipe() asks otherwise
+#define PIPEMAXPAGES 16  // most pages mkpipe() may ask for
+#define NSHM         16  // shared memory segments per system
+#define NPCACHE     256  // pages of MAP_SHARED file mappings kept in the page cache
+#define SHMPAGES    256  // max pages in a shared memory segment
+#define SHMNAME      16  // max length of a segment name, including nul
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
@@ -11,4 +27,6 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define SWAPSIZE    16384  // size of swap area after the file system, in blocks
+#define SWAPLOW       256  // kswapd keeps at least this many pages free
 
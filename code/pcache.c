@@ -0,0 +1,211 @@
+//
+// Page cache for MAP_SHARED file mappings.
+//
+// Every process that maps a page of a file MAP_SHARED maps the
+// one frame cached here for that (inode, offset), so a store by
+// one is seen by the others at once.  readi() and writei() go
+// through the same frames while they are cached, so read() and
+// write() agree with the mappings too.  Dirty frames still reach
+// the disk when a mapping goes away (see vmawriteback()).
+//
+// The cache holds a reference on each frame, and each mapping
+// another.  A frame only the cache still holds is mapped by no
+// one, and its stores have been written back by whoever made
+// them: munmap() drops such frames of the file it unmaps, and
+// pcget() reuses their slots when the table is full.  With
+// every slot still mapped, a fault on an uncached page fails:
+// NPCACHE bounds the file pages mapped MAP_SHARED at once.
+// iput() drops all the pages of an inode with its last
+// reference, so no entry outlives the inode it names.
+//
+// Every read() of a mapped file looks the table up, and only
+// faults and unmaps change it, so it is kept under a
+// reader-writer lock.  Lookups share it, even pccopy() storing
+// into a frame: the inode lock its caller holds already keeps
+// writei() apart from readi() and other writei()s.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "rwlock.h"
+#include "fs.h"
+#include "file.h"
+
+struct cpage {
+  struct inode *ip;   // 0 if the slot is free
+  uint off;           // File offset of the page
+  char *mem;          // The frame
+};
+
+struct {
+  struct rwlock lock;
+  struct cpage page[NPCACHE];
+} pcache;   //共享文件映射的页缓存
+
+void
+pcinit(void)
+{
+  initrwlock(&pcache.lock, "pcache");
+}
+
+// The cached page of ip at offset off.  Caller holds pcache.lock,
+// for reading at least.
+static struct cpage*
+pclookup(struct inode *ip, uint off)
+{
+  struct cpage *c;
+
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++)
+    if(c->ip == ip && c->off == off)
+      return c;
+  return 0;
+}
+
+// A slot whose frame is mapped by no one, emptied, or 0.
+// Caller holds pcache.lock for writing.
+static struct cpage*
+pcvictim(void)
+{
+  struct cpage *c;
+
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->ip && kref(c->mem) == 1){
+      kfree(c->mem);
+      c->ip->nmap--;
+      c->ip = 0;
+      return c;
+    }
+  }
+  return 0;
+}
+
+// Return the frame holding the page of ip at file offset off,
+// with a reference for the caller to map, reading it in if it
+// is not cached yet: n bytes from the file and zeros after.
+// Returns 0 if out of memory, or if every slot holds a frame
+// that is still mapped: a frame outside the cache would not be
+// shared with the other mappings of the page.
+char*
+pcget(struct inode *ip, uint off, uint n)
+{
+  struct cpage *c;
+  char *mem;
+
+  ilockshared(ip);   //不让write()在读入和入缓存之间改文件
+  acquireread(&pcache.lock);
+  if((c = pclookup(ip, off)) != 0){
+    kdup(c->mem);
+    releaseread(&pcache.lock);
+    iunlockshared(ip);
+    return c->mem;
+  }
+  releaseread(&pcache.lock);
+
+  if((mem = allocpage()) == 0){
+    iunlockshared(ip);
+    return 0;
+  }
+  memset(mem, 0, PGSIZE);
+  readi(ip, mem, off, n);
+
+  acquirewrite(&pcache.lock);
+  if((c = pclookup(ip, off)) != 0){   //另一个进程同时读进来了，用它的
+    kfree(mem);
+    mem = c->mem;
+    kdup(mem);
+  } else if((c = pclookup(0, 0)) != 0 || (c = pcvictim()) != 0){
+    c->ip = ip;
+    c->off = off;
+    c->mem = mem;
+    ip->nmap++;
+    kdup(mem);   //缓存一份引用，调用者一份
+  } else {   //缓存满了，都有人映射着；私有的一页就不是共享映射了
+    kfree(mem);
+    mem = 0;
+  }
+  releasewrite(&pcache.lock);
+  iunlockshared(ip);
+  return mem;
+}
+
+// If the page of ip holding offset off is cached, copy n bytes
+// at off, which must not cross a page, from it to buf, or from
+// buf to it if write is set.  Returns 1 if it did, 0 if the page
+// is not cached.  Called by readi() and writei().
+int
+pccopy(struct inode *ip, uint off, char *buf, uint n, int write)
+{
+  struct cpage *c;
+
+  acquireread(&pcache.lock);
+  if((c = pclookup(ip, PGROUNDDOWN(off))) == 0){
+    releaseread(&pcache.lock);
+    return 0;
+  }
+  if(write)
+    memmove(c->mem + off % PGSIZE, buf, n);
+  else
+    memmove(buf, c->mem + off % PGSIZE, n);
+  releaseread(&pcache.lock);
+  return 1;
+}
+
+// pccopy() for readiput(): hand the n bytes at off, which must
+// not cross a page, to put(arg, data, n) straight from the
+// cached page.  Returns what put returned, or -1 if the page is
+// not cached.
+int
+pcput(struct inode *ip, uint off, uint n, int (*put)(void*, char*, int), void *arg)
+{
+  struct cpage *c;
+  int r;
+
+  acquireread(&pcache.lock);
+  if((c = pclookup(ip, PGROUNDDOWN(off))) == 0){
+    releaseread(&pcache.lock);
+    return -1;
+  }
+  r = put(arg, c->mem + off % PGSIZE, n);
+  releaseread(&pcache.lock);
+  return r;
+}
+
+// Drop the cached pages of ip that nothing maps any more.
+void
+pctrim(struct inode *ip)
+{
+  struct cpage *c;
+
+  acquirewrite(&pcache.lock);
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->ip == ip && kref(c->mem) == 1){
+      kfree(c->mem);
+      c->ip = 0;
+      ip->nmap--;
+    }
+  }
+  releasewrite(&pcache.lock);
+}
+
+// Drop all the cached pages of ip.  Frames still mapped stay
+// with their mappings.  Called by iput() with the last reference,
+// and by iget() before it reuses the inode's slot.
+void
+pcdrop(struct inode *ip)
+{
+  struct cpage *c;
+
+  acquirewrite(&pcache.lock);
+  for(c = pcache.page; c < &pcache.page[NPCACHE]; c++){
+    if(c->ip == ip){
+      kfree(c->mem);
+      c->ip = 0;
+      ip->nmap--;
+    }
+  }
+  releasewrite(&pcache.lock);
+}
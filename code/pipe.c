@@ -8,28 +8,92 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+// A pipe's bytes live in a ring of pages, PIPEPAGES of them
+// unless mkpipe() chose another power of two, and move in
+// and out with a memmove() for each run that does not cross a
+// page boundary.  Readers sleep only on an empty pipe and
+// writers only on a full one, so a wakeup is due only when a
+// pipe stops being empty or full, not after every write or read.
 
 struct pipe {
   struct spinlock lock;  //管道锁
-  char data[PIPESIZE];   //管道的内存数据区
+  char *data[PIPEMAXPAGES]; //管道的数据页，首尾相接成环
+  uint size;      // bytes in the ring 管道容量
   uint nread;     // number of bytes read  读多少字节
   uint nwrite;    // number of bytes written 写多少字节
   int readopen;   // read fd is still open  读端仍然打开
   int writeopen;  // write fd is still open 写端仍然打开
 };
 
+// Copy n bytes from src into p, which has room for them.
+// Wakes readers if p was empty.
+static void
+put(struct pipe *p, char *src, uint n)
+{
+  uint off, m;
+
+  if(n > 0 && p->nwrite == p->nread)   //空变成不空，叫醒读者
+    wakeup(&p->nread);
+  for(; n > 0; n -= m, src += m){
+    off = p->nwrite % p->size;
+    m = min(n, PGSIZE - off % PGSIZE);   //不跨页的一段
+    memmove(p->data[off / PGSIZE] + off % PGSIZE, src, m);
+    p->nwrite += m;
+  }
+}
+
+// Copy n bytes from p, which holds them, to dst.
+// Wakes writers if p was full.
+static void
+get(struct pipe *p, char *dst, uint n)
+{
+  uint off, m;
+
+  if(n > 0 && p->nwrite == p->nread + p->size)   //满变成不满，叫醒写者
+    wakeup(&p->nwrite);
+  for(; n > 0; n -= m, dst += m){
+    off = p->nread % p->size;
+    m = min(n, PGSIZE - off % PGSIZE);
+    memmove(dst, p->data[off / PGSIZE] + off % PGSIZE, m);
+    p->nread += m;
+  }
+}
+
+// Free p and its pages.
+static void
+pipefree(struct pipe *p)
+{
+  int i;
+
+  for(i = 0; i < PIPEMAXPAGES; i++)
+    if(p->data[i])
+      kfree(p->data[i]);
+  kfree((char*)p);
+}
+
+// Make a pipe whose ring has npages pages, a power of two no
+// more than PIPEMAXPAGES, and a file for each end of it.
 int
-pipealloc(struct file **f0, struct file **f1)   //创建管道
+pipealloc(struct file **f0, struct file **f1, int npages)   //创建管道
 {
   struct pipe *p;
+  int i;
 
   p = 0;
   *f0 = *f1 = 0;
+  if(npages < 1 || npages > PIPEMAXPAGES || (npages & (npages-1)) != 0)
+    return -1;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)  //分配文件结构体
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)   //分配管道内存区
+  if((p = (struct pipe*)kalloc()) == 0)   //分配管道结构体
     goto bad;
+  memset(p->data, 0, sizeof(p->data));
+  for(i = 0; i < npages; i++)
+    if((p->data[i] = kalloc()) == 0)   //分配管道内存区
+      goto bad;
+  p->size = npages*PGSIZE;
   p->readopen = 1;     //读端打开
   p->writeopen = 1;    //写端打开
   p->nwrite = 0;       //写字节数初始为0
@@ -49,7 +113,7 @@ pipealloc(struct file **f0, struct file **f1)   //创建管道
 //PAGEBREAK: 20
  bad:         //如果发生错误
   if(p)  //如果已经分配了内存区
-    kfree((char*)p);   //释放
+    pipefree(p);   //释放
   if(*f0)   //如果已分配了文件结构体1
     fileclose(*f0);    //释放
   if(*f1)   //如果已分配了文件结构体2
@@ -70,7 +134,7 @@ pipeclose(struct pipe *p, int writable)   //关闭管道
   }
   if(p->readopen == 0 && p->writeopen == 0){   //如果读端和写端都关闭了
     release(&p->lock);   //解锁
-    kfree((char*)p);     //释放管道的内存数据区
+    pipefree(p);         //释放管道的内存数据区
   } else
     release(&p->lock);   //否则也要解锁再退出
 }
@@ -78,43 +142,67 @@ pipeclose(struct pipe *p, int writable)   //关闭管道
 //PAGEBREAK: 40
 int pipewrite(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int i, m;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //管道已经满了需要读
+  for(i = 0; i < n; i += m){
+    while(p->nwrite == p->nread + p->size){  //管道已经满了需要读
       if(p->readopen == 0 || myproc()->killed){  //读端被关闭或者进程被killed
         release(&p->lock);   //释放锁
         return -1;           //返回-1表错误
       }
-      wakeup(&p->nread);    //唤醒读进程
-      sleep(&p->nwrite, &p->lock);  //写进程睡眠
+      sleep(&p->nwrite, &p->lock);  //写进程睡眠，读者读走时会叫醒
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];   //写，即数据放入缓存区
+    m = min(n - i, p->size - (p->nwrite - p->nread));
+    put(p, addr + i, m);   //能放多少放多少
   }
-  wakeup(&p->nread);  //写了之后唤醒读进程
   release(&p->lock);  //释放锁
   return n;    //返回写了多少字节
 }
 
-int piperead(struct pipe *p, char *addr, int n)
+// Wait until p has room.  Returns how much, or -1 if the read
+// side is closed or the process is killed.  Another writer may
+// take the room first.
+int
+pipewait(struct pipe *p)
 {
-  int i;
+  int n;
+
+  acquire(&p->lock);
+  while(p->nwrite == p->nread + p->size){  //管道满了
+    if(p->readopen == 0 || myproc()->killed)
+      break;
+    sleep(&p->nwrite, &p->lock);
+  }
+  n = p->readopen && !myproc()->killed ? p->size - (p->nwrite - p->nread) : -1;
+  release(&p->lock);
+  return n;
+}
+
+// Write as much of the n bytes at addr to p as fits without
+// waiting, which may be none.  Returns how many it wrote.
+int
+pipeput(struct pipe *p, char *addr, int n)
+{
+  acquire(&p->lock);
+  n = min(n, p->size - (p->nwrite - p->nread));
+  put(p, addr, n);
+  release(&p->lock);
+  return n;
+}
 
+int piperead(struct pipe *p, char *addr, int n)
+{
   acquire(&p->lock);    //取锁
   while(p->nread == p->nwrite && p->writeopen){  //管道空
     if(myproc()->killed){       //如果进程被killed
       release(&p->lock);        //释放锁
       return -1;         //返回-1表错误
     }
-    sleep(&p->nread, &p->lock); //读进程休眠
-  }
-  for(i = 0; i < n; i++){  //循环n次
-    if(p->nread == p->nwrite)   //数据已经读完，管道空了
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];  //读操作，搬运数据的一个过程
+    sleep(&p->nread, &p->lock); //读进程休眠，写者写入时会叫醒
   }
-  wakeup(&p->nwrite);  //读完之后唤醒写进程
+  n = min(n, p->nwrite - p->nread);   //数据已经读完，管道空了
+  get(p, addr, n);   //读操作，一段一段地搬运
   release(&p->lock);   //释放锁
-  return i;    //返回读取的字节数
-}
\ No newline at end of file
+  return n;    //返回读取的字节数
+}
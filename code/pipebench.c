@@ -0,0 +1,67 @@
+// Pipe throughput benchmark.  A child writes a number of
+// kilobytes into a pipe in chunks of a given size, and the
+// parent reads them out as fast as it can.  With a pipe size,
+// the pipe comes from mkpipe() instead of pipe().
+//
+// usage: pipebench [kbytes] [chunk] [pipesize]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+char buf[16384];
+
+int
+main(int argc, char *argv[])
+{
+  int kb, chunk, size, n, tot, pid, fds[2], start, elapsed;
+
+  kb = 8192;
+  chunk = 4096;
+  size = 0;
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(argc > 2)
+    chunk = atoi(argv[2]);
+  if(argc > 3)
+    size = atoi(argv[3]);
+  if(kb <= 0 || chunk <= 0 || chunk > sizeof(buf) ||
+     (size ? mkpipe(fds, size) : pipe(fds)) < 0){
+    printf(2, "usage: pipebench [kbytes] [chunk] [pipesize]\n");
+    exit();
+  }
+
+  start = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf(2, "pipebench: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(tot = 0; tot < kb*1024; tot += n){
+      n = kb*1024 - tot;
+      if(n > chunk)
+        n = chunk;
+      if(write(fds[1], buf, n) != n){
+        printf(2, "pipebench: write failed\n");
+        break;
+      }
+    }
+    exit();
+  }
+  close(fds[1]);
+  tot = 0;
+  while((n = read(fds[0], buf, chunk)) > 0)
+    tot += n;
+  wait();
+  elapsed = uptime() - start;
+
+  // A tick is 10ms.
+  printf(1, "pipebench: %d KB in %d byte chunks in %d ticks",
+         tot / 1024, chunk, elapsed);
+  if(elapsed > 0)
+    printf(1, ", %d KB/s", tot / 1024 * 100 / elapsed);
+  printf(1, "\n");
+  exit();
+}
@@ -6,24 +6,86 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "rcu.h"
+#include "traps.h"
+
+// Sleeping processes are kept in hash chains by the channel
+// they sleep on, linked through p->chnext, so that wakeup()
+// only looks at the sleepers that share a bucket with chan.
+#define NSLEEPQ 64
+#define SLEEPQ(chan) (((uint)(chan) >> 2) % NSLEEPQ)
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct proc *sleepq[NSLEEPQ];   //按休眠对象散列的等待队列
+  int nfreeing;            // Slots freeproc() will hand back after an RCU grace period
+  int npinwait;            // Threads in pinwait(), sleeping on &npinwait
 } ptable;
 
+// Lookups by pid, in kill() and getpriority(), take no lock
+// but read the table under RCU.  A freed slot keeps its state,
+// with pid 0, until a grace period has passed (see freeproc()),
+// so such a lookup never finds it reused by another process.
+static struct rcuhead procrcu[NPROC];
+
+// Per-CPU run queues of RUNNABLE processes, one FIFO list per
+// priority level, linked through p->next.  A CPU's scheduler
+// holds the lock of its own queue while a process runs, and the
+// process hands it back when it switches out (see sched()).
+// ptable.lock still guards sleep/wakeup and the parent/child
+// bookkeeping; it is taken before a run queue lock, never after.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  int n;               // Length, read without the lock by thieves
+} runq[NCPU];
+
+// Multilevel feedback queue.  A process starts at the level its
+// nice value gives it (level 0 for nice 0) and runs for up to
+// SLICE(level) timer ticks at a time.  Once it has used that much
+// CPU at a level, whether in one go or a bit at a time between
+// sleeps, it moves down a level.  Every BOOSTTICKS ticks
+// everything goes back to its starting level, so that batch jobs
+// are not starved by interactive ones.
+#define SLICE(prio)    (1 << (prio))
+#define BASEPRIO(nice) ((nice) * NPRIO / (NICEMAX+1))
+
+// Threads made by clone() share their creator's page table, and
+// each keeps a copy of its size and regions (sz, vma), which
+// vmsync() brings up to date after a change.  The regions' file
+// and segment references are held once for the address space,
+// and dropped by whichever of the threads is freed last.
+// A lock per address space, hashed by page directory, is held
+// while a page is faulted in or the layout changes, so that
+// threads do not race to fill in the same page.
+#define NMMLOCK 16
+#define MMLOCK(pgdir) (((uint)(pgdir) >> PTXSHIFT) % NMMLOCK)
+
+static struct sleeplock mmlocks[NMMLOCK];
+
 static struct proc *initproc;
+static int nidle;   // CPUs halted in idle()
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void freeproc(struct proc*);
 
 void
 pinit(void)   //初始化进程表，就是初始化进程表的锁
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(i = 0; i < NMMLOCK; i++)
+    initsleeplock(&mmlocks[i], "mm");
 }
 
 // Must be called with interrupts disabled
@@ -81,22 +143,43 @@ allocproc(void)
 
   acquire(&ptable.lock);
 
+  for(;;){
     /*从头至尾依次寻找空间任务结构体*/
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) 
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) 
       if(p->state == UNUSED)
-          goto found;
+        goto found;
+    if(ptable.nfreeing == 0 || myproc() == 0)
+      break;
+    sleep(&ptable.nfreeing, &ptable.lock);   //等宽限期过去，释放出的槽位
+  }
   release(&ptable.lock);
   return 0;
 
 found:
   p->state = EMBRYO;   //设置状态为EMBRYO
   p->pid = nextpid++;  //设置进程号
+  p->killed = 0;
+  p->pgdir = 0;
+  p->insyscall = 0;
+  p->files = 0;
+  p->nfhold = 0;
+  p->pinhi = 0;
+  p->unmaphi = 0;
+  p->ring = 0;
+  p->lastcpu = 0;
+  p->cpu = cpuid();    //先放在创建它的CPU的运行队列上
+  p->nice = 0;
+  p->prio = 0;
+  p->ticks = 0;
+  memset(p->vma, 0, sizeof p->vma);   //槽位上一个主人的区域不能留下，fork失败时vmaput()会看到
 
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){  //分配内核栈
-      p->state = UNUSED;    //如果分配失败，回收该任务结构体后返回
+      acquire(&ptable.lock);
+      freeproc(p);    //如果分配失败，回收该任务结构体后返回
+      release(&ptable.lock);
       return 0;
   }
   sp = p->kstack + KSTACKSIZE;  //栈顶
@@ -119,6 +202,99 @@ found:
   return p;
 }
 
+// Append p to run queue rq, whose lock the caller holds.
+// prioboost() may change p->prio meanwhile without that lock,
+// so it is read once: p goes on one level's list, whole.
+static void
+enqueue(struct runq *rq, struct proc *p)
+{
+  int prio = *(volatile int*)&p->prio;
+
+  p->next = 0;
+  if(rq->tail[prio])
+    rq->tail[prio]->next = p;
+  else
+    rq->head[prio] = p;
+  rq->tail[prio] = p;
+  rq->n++;
+}
+
+// Take the first process of the highest non-empty level of
+// run queue rq, whose lock the caller holds, and mark it
+// RUNNING on CPU c.  Returns 0 if rq is empty.
+static struct proc*
+dequeue(struct runq *rq, int c)
+{
+  struct proc *p;
+  int i;
+
+  for(i = 0; i < NPRIO; i++)   //优先级从高到低
+    if(rq->head[i])
+      break;
+  if(i == NPRIO)
+    return 0;
+  p = rq->head[i];
+  rq->head[i] = p->next;
+  if(rq->head[i] == 0)
+    rq->tail[i] = 0;
+  rq->n--;
+  p->next = 0;
+  p->state = RUNNING;
+  p->cpu = c;
+  return p;
+}
+
+// Lock and return this CPU's run queue.  Interrupts stay
+// off from picking the queue to holding its lock, so that
+// the caller cannot move to another CPU in between.
+static struct runq*
+lockrunq(void)
+{
+  struct runq *rq;
+
+  pushcli();
+  rq = &runq[cpuid()];
+  acquire(&rq->lock);
+  popcli();
+  return rq;
+}
+
+// Something has just been queued on cpu's run queue: if any
+// CPU is halted in idle(), preferably cpu itself, interrupt it
+// so that it runs or steals the new process.
+static void
+wakecpu(int cpu)
+{
+  struct cpu *c;
+  int i;
+
+  __sync_synchronize();   //先入队再看有没有空闲CPU，与idle()相对
+  if(nidle == 0)
+    return;
+  for(i = 0; i < ncpu; i++){
+    c = &cpus[(cpu + i) % ncpu];
+    if(c->idle){
+      lapicipi(c->apicid, T_IRQ0 + IRQ_WAKE);
+      return;
+    }
+  }
+}
+
+// Make p RUNNABLE and queue it on the CPU it last ran on, whose
+// cache may still hold its data.  If that CPU is busy switching
+// p out, this waits until it is done.
+static void
+setrunnable(struct proc *p)
+{
+  struct runq *rq = &runq[p->cpu];
+
+  acquire(&rq->lock);
+  p->state = RUNNABLE;
+  enqueue(rq, p);
+  wakecpu(p->cpu);
+  release(&rq->lock);
+}
+
 //PAGEBREAK: 32
 // Set up first user process.
 void userinit(void)
@@ -144,6 +320,7 @@ void userinit(void)
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
+  p->files = filesalloc();
 
   // this assignment to p->state lets other cores
   // run this process. the acquire forces the above
@@ -151,39 +328,124 @@ void userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;    //可上CPU运行了
+  setrunnable(p);    //可上CPU运行了
+
+  release(&ptable.lock);
+}
+
+// Start a kernel process running fn(), which must never return.
+// It has no user memory: its page table only maps the kernel.
+void
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0 || (p->pgdir = setupkvm()) == 0)
+    panic("kproc");
+  // forkret returns to fn instead of trapret.
+  *(uint*)((char*)p->context + sizeof(*p->context)) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
 
+  acquire(&ptable.lock);
+  setrunnable(p);
   release(&ptable.lock);
 }
 
 // Grow current process's memory by n bytes.
+// Growing only reserves address space: the new pages are
+// allocated and zeroed by pagefault() on first touch.
+// Caller must hold mmlock(curproc->pgdir).
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
   uint sz;
+  struct vma *v;
   struct proc *curproc = myproc();
 
   sz = curproc->sz;
-  if(n > 0){   
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)  //调用allocuvm增长进程空间
+  if(n > 0){
+    if(sz + n < sz || sz + n >= KERNBASE)  //只预留虚拟地址空间，不分配物理页
       return -1;
+    for(v = curproc->vma; v < &curproc->vma[NVMA]; v++)
+      if(v->end && v->flags && PGROUNDUP(sz + n) > v->start)  //不能长进mmap区域
+        return -1;
+    sz += n;
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0) //调用deallocuvm减少进程空间
+    if((sz = shrinkuvm(curproc, sz, sz + n)) == 0) //减少进程空间并刷新TLB
       return -1;
   }
   curproc->sz = sz;    //更新当前进程大小
-  switchuvm(curproc);  //重新加载当前进程的用户空间
+  vmsync(curproc);     //同一地址空间的线程也要看到新的大小
   return 0;
 }
 
+// Create a thread: a process that shares the current process's
+// address space and starts in fn(arg), on the user stack that
+// ends at stack.  It shares the table of open files too, so a
+// descriptor opened or closed by one thread is by all; it gets
+// its own reference to the current directory.  Returns its pid,
+// which the creator passes to join().
+int
+clone(uint fn, uint arg, uint stack)
+{
+  int pid;
+  uint sp, ustack[2];
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  ustack[0] = 0xffffffff;  // fake return PC
+  ustack[1] = arg;
+  sp = stack - sizeof(ustack);
+  if(stack % 4 || sp > stack || prefault(sp, sizeof(ustack), 1) < 0)
+    return -1;
+  if((np = allocproc()) == 0)
+    return -1;
+
+  mmlock(curproc->pgdir);
+  if(copyout(curproc->pgdir, sp, ustack, sizeof(ustack)) < 0){
+    mmunlock(curproc->pgdir);
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
+  np->pgdir = curproc->pgdir;   //共用页表
+  np->sz = curproc->sz;
+  memmove(np->vma, curproc->vma, sizeof(np->vma));   //只是副本，引用算在整个地址空间上
+  mmunlock(curproc->pgdir);
+
+  np->parent = curproc;
+  *np->tf = *curproc->tf;
+  np->tf->eip = fn;
+  np->tf->esp = sp;
+  np->ring = curproc->ring;
+
+  np->files = filesdup(curproc->files);   //线程共用描述符表
+  np->cwd = idup(curproc->cwd);
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+  np->nice = curproc->nice;
+  np->prio = BASEPRIO(np->nice);
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+  np->unmaplo = curproc->unmaplo;   //别的线程可能正在pinwait()里，新线程也不能用那段内存
+  np->unmaphi = curproc->unmaphi;
+  setrunnable(np);
+  release(&ptable.lock);
+
+  return pid;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *curproc = myproc();
 
@@ -193,30 +455,44 @@ fork(void)
   }
 
   // Copy process state from proc. 从父进程复制各种数据信息
+  mmlock(curproc->pgdir);   //别的线程这时不能改动地址空间
   if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){ 
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+    mmunlock(curproc->pgdir);
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
+  if(vmadup(np, curproc) < 0){   //子进程继承按需调页区域和mmap区域
+    mmunlock(curproc->pgdir);
+    vmaput(0, np->vma);
+    freevm(np->pgdir);
+    np->pgdir = 0;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
   np->sz = curproc->sz;   //用户部分的大小
+  mmunlock(curproc->pgdir);
   np->parent = curproc;   //子进程的父进程是当前进程
   *np->tf = *curproc->tf; //子进程的栈帧就是父进程的栈帧
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;   //将中断栈帧的eax值修改为0
+  np->ring = curproc->ring;   //内存是副本，队列也在同一地址
 
-  for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
+  np->files = filescopy(curproc->files);   //子进程得到描述符表的副本
   np->cwd = idup(curproc->cwd);
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));  //复制进程名字
+  np->nice = curproc->nice;   //继承nice值，从它对应的级别开始
+  np->prio = BASEPRIO(np->nice);
 
   pid = np->pid;    //进程号
 
   acquire(&ptable.lock);
-  np->state = RUNNABLE;    //子进程可以跑了!!!
+  setrunnable(np);    //子进程可以跑了!!!
   release(&ptable.lock);
 
   return pid;
@@ -230,18 +506,13 @@ exit(void)
 {
   struct proc *curproc = myproc();  //当前进程
   struct proc *p;
-  int fd;
 
   if(curproc == initproc)   //init进程是不能退出的，有特殊用处
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){  //关闭所有文件
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
-  }
+  // Close all open files, unless other threads still use them.
+  filesput(curproc->files);
+  curproc->files = 0;
 
   begin_op();
   iput(curproc->cwd);  //放下当前工作路径的inode
@@ -253,6 +524,12 @@ exit(void)
   // Parent might be sleeping in wait().
   wakeup1(curproc->parent);   //唤醒父进程
 
+  // A sibling may be waiting in pinwait() for the system
+  // call we are exiting from.
+  curproc->pinhi = 0;
+  if(ptable.npinwait)
+    wakeup1(&ptable.npinwait);
+
   // Pass abandoned children to init.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){     //将被遗弃的孩子过继给init进程
     if(p->parent == curproc){
@@ -263,18 +540,244 @@ exit(void)
   }
 
   // Jump into the scheduler, never to return.
+  // wait() frees our stack only once this CPU's scheduler
+  // has let go of the run queue lock, after the switch.
   curproc->state = ZOMBIE;  //状态变为僵尸状态
+  lockrunq();
+  release(&ptable.lock);
   sched();    //调度，永远不会返回
   panic("zombie exit");   //因为不会返回，正常情况是不可能执行到这的
 }
 
+// Number of processes other than p using page directory pgdir:
+// the threads of an address space.  Caller holds ptable.lock.
+static int
+nsharing(pde_t *pgdir, struct proc *p)
+{
+  struct proc *q;
+  int n;
+
+  n = 0;
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(q != p && q->state != UNUSED && q->pgdir == pgdir)
+      n++;
+  return n;
+}
+
+// Number of other threads sharing p's address space.
+int
+vmshared(struct proc *p)
+{
+  int n;
+
+  acquire(&ptable.lock);
+  n = nsharing(p->pgdir, p);
+  release(&ptable.lock);
+  return n;
+}
+
+// Copy p's size and regions to the other threads sharing its
+// address space, after p has changed them.
+// Caller holds mmlock(p->pgdir).
+void
+vmsync(struct proc *p)
+{
+  struct proc *q;
+
+  acquire(&ptable.lock);
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++){
+    if(q == p || q->state == UNUSED || q->pgdir != p->pgdir)
+      continue;
+    q->sz = p->sz;
+    memmove(q->vma, p->vma, sizeof(q->vma));
+  }
+  release(&ptable.lock);
+}
+
+// Is a thread sharing p's address space, other than p, in a
+// system call that has faulted in memory in [lo, hi)?
+// Caller holds ptable.lock.
+static int
+pinned(struct proc *p, uint lo, uint hi)
+{
+  struct proc *q;
+
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(q != p && q->pgdir == p->pgdir && q->state != UNUSED &&
+       q->state != ZOMBIE && q->pinhi && q->pinlo < hi && lo < q->pinhi)
+      return 1;
+  return 0;
+}
+
+// The current process is about to unmap [lo, hi): wait until no
+// other thread sharing its address space is in a system call
+// that may touch memory there, and keep any more from faulting
+// it in (see faultin()) until unpin().  Without this a sibling
+// that checked its buffer before the unmap could fault on it in
+// the kernel after.  One thread at a time unmaps.  Must be
+// called before mmlock(), which the waited-for calls may need.
+void
+pinwait(uint lo, uint hi)
+{
+  struct proc *p = myproc();
+  struct proc *q;
+
+  acquire(&ptable.lock);
+  while(p->unmaphi)   //另一个线程正在解除映射
+    sleep(&ptable.npinwait, &ptable.lock);
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++){
+    if(q != p && q->pgdir == p->pgdir && q->state != UNUSED){
+      q->unmaplo = lo;
+      q->unmaphi = hi;
+    }
+  }
+  ptable.npinwait++;
+  __sync_synchronize();   //先公布范围再看别的线程，faultin()反过来做
+  while(pinned(p, lo, hi))
+    sleep(&ptable.npinwait, &ptable.lock);
+  ptable.npinwait--;
+  release(&ptable.lock);
+}
+
+// The unmap that pinwait() was for is done.
+void
+unpin(void)
+{
+  struct proc *p = myproc();
+  struct proc *q;
+
+  acquire(&ptable.lock);
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++){
+    if(q != p && q->pgdir == p->pgdir && q->state != UNUSED){
+      q->unmaphi = 0;
+      q->unmaplo = 0;
+    }
+  }
+  wakeup1(&ptable.npinwait);
+  release(&ptable.lock);
+}
+
+// The current system call is over: it no longer holds up
+// pinwait() in the threads sharing its address space.
+void
+pinclear(void)
+{
+  myproc()->pinhi = 0;
+  __sync_synchronize();
+  if(ptable.npinwait){
+    acquire(&ptable.lock);
+    wakeup1(&ptable.npinwait);
+    release(&ptable.lock);
+  }
+}
+
+// Lock the address space with page directory pgdir.
+void
+mmlock(pde_t *pgdir)
+{
+  acquiresleep(&mmlocks[MMLOCK(pgdir)]);
+}
+
+void
+mmunlock(pde_t *pgdir)
+{
+  releasesleep(&mmlocks[MMLOCK(pgdir)]);
+}
+
+// Give the current process the user memory that exec() has
+// built.  Returns the old page directory, with its regions
+// copied to oldvma, for the caller to free; or 0 if threads
+// still share it.
+pde_t*
+switchmm(pde_t *pgdir, uint sz, struct vma *vma, struct vma *oldvma)
+{
+  struct proc *curproc = myproc();
+  pde_t *old;
+
+  acquire(&ptable.lock);
+  old = curproc->pgdir;
+  memmove(oldvma, curproc->vma, sizeof(curproc->vma));
+  curproc->pgdir = pgdir;
+  curproc->sz = sz;
+  memmove(curproc->vma, vma, sizeof(curproc->vma));
+  if(nsharing(old, curproc) > 0)
+    old = 0;
+  release(&ptable.lock);
+  return old;
+}
+
+// RCU callback of freeproc(): nothing can be looking at p any
+// more, so free its kernel stack and let allocproc() have it.
+static void
+procfreed(void *a)
+{
+  struct proc *p = a;
+
+  acquire(&ptable.lock);
+  if(p->kstack)
+    kfree(p->kstack);  //回收内核栈
+  p->kstack = 0;
+  p->killed = 0;
+  p->state = UNUSED; //状态变为UNUSED,表该结构体空闲了
+  ptable.nfreeing--;
+  wakeup1(&ptable.nfreeing);
+  release(&ptable.lock);
+}
+
+// Take p, which is not running, out of the table: it can no
+// longer be found by pid.  The slot is freed only after an RCU
+// grace period, since lookups may still be using it: kill()
+// setting p->killed, or procdump() reading its kernel stack.
+// Caller must hold ptable.lock.
+static void
+freeproc(struct proc *p)
+{
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  ptable.nfreeing++;
+  callrcu(&procrcu[p - ptable.proc], procfreed, p);
+}
+
+// Free zombie child p and return its pid.  Called with
+// ptable.lock held, which it releases.  The user memory goes
+// too unless other threads still share it; writing its shared
+// mappings back to their files can sleep, so that happens
+// after letting go of the lock.
+static int
+reap(struct proc *p)
+{
+  struct vma vma[NVMA];
+  pde_t *pgdir;
+  int pid;
+
+  // Make sure it is off its CPU's stack.
+  acquire(&runq[p->cpu].lock);
+  release(&runq[p->cpu].lock);
+  pid = p->pid;      
+  pgdir = p->pgdir;
+  p->pgdir = 0;
+  if(nsharing(pgdir, p) == 0)   //最后一个使用这个地址空间的线程
+    memmove(vma, p->vma, sizeof(vma));
+  else
+    pgdir = 0;
+  freeproc(p);   //宽限期过后回收内核栈，状态变为UNUSED
+  release(&ptable.lock);  //释放锁
+  if(pgdir){
+    vmaput(pgdir, vma);  //写回共享映射的脏页，放下文件的inode
+    freevm(pgdir);  //回收用户空间以及页表占用的内存
+  }
+  return pid;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+// Threads are left for join().
 int
 wait(void)
 {
   struct proc *p;
-  int havekids, pid;
+  int havekids;
   struct proc *curproc = myproc();
   
   acquire(&ptable.lock);
@@ -282,23 +785,11 @@ wait(void)
     // Scan through table looking for exited children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){ //循环寻找子进程
-      if(p->parent != curproc)  //如果进程p的父进程不是当前进程
+      if(p->parent != curproc || p->pgdir == curproc->pgdir)  //不是子进程，或是本进程的线程(由join回收)
         continue;
       havekids = 1;   //当前进程有子进程
-      if(p->state == ZOMBIE){  //如果子进程的状态是ZOMBIE，回收它的资源
-        // Found one.
-        pid = p->pid;      
-        kfree(p->kstack);  //回收内核栈
-        p->kstack = 0;
-        freevm(p->pgdir);  //回收用户空间以及页表占用的五ii内存
-        p->pid = 0;   
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED; //状态变为UNUSED,表该结构体空闲了
-        release(&ptable.lock);  //释放锁
-        return pid;
-      }
+      if(p->state == ZOMBIE)  //如果子进程的状态是ZOMBIE，回收它的资源
+        return reap(p);
     }
 
     // No point waiting if we don't have any children.
@@ -313,12 +804,95 @@ wait(void)
   }
 }
 
+// Wait for thread tid, made by clone() in this process, to exit,
+// and free it.  Returns tid, or -1 if there is no such thread.
+int
+join(int tid)
+{
+  struct proc *p;
+  struct proc *curproc = myproc();
+
+  acquire(&ptable.lock);
+  for(;;){
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+      if(p->pid == tid && p->parent == curproc && p->pgdir == curproc->pgdir)
+        break;
+    if(p == &ptable.proc[NPROC] || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+    if(p->state == ZOMBIE)
+      return reap(p);
+    sleep(curproc, &ptable.lock);   //线程退出时会唤醒父进程
+  }
+}
+
+// Take a RUNNABLE process off another CPU's run queue, for
+// CPU me whose own queue is empty.  Returns 0 if there is
+// nothing to steal.
+static struct proc*
+steal(int me)
+{
+  struct runq *rq;
+  struct proc *p;
+  int i;
+
+  for(i = 1; i < ncpu; i++){
+    rq = &runq[(me + i) % ncpu];
+    if(rq->n == 0)   //不加锁先看一眼，空队列就不去抢它的锁
+      continue;
+    acquire(&rq->lock);
+    p = dequeue(rq, me);
+    release(&rq->lock);
+    if(p)
+      return p;
+  }
+  return 0;
+}
+
+// Nothing to run anywhere: halt until an interrupt.  The clock
+// is stopped meanwhile (see clockstop()), except on CPU 0 while
+// other CPUs are busy, since it keeps ticks for them.
+static void
+idle(void)
+{
+  struct cpu *c = mycpu();
+  int i, n;
+
+  cli();
+  c->idle = 1;
+  n = __sync_add_and_fetch(&nidle, 1);   //先标记空闲再查队列，与wakecpu()相对
+  for(i = 0; i < ncpu; i++)
+    if(runq[i].n)
+      break;
+  if(i == ncpu){
+    if(c != &cpus[0] || n == ncpu){
+      clockstop();
+      __sync_synchronize();
+      if(c == &cpus[0] && nidle != ncpu)   //别的CPU刚醒来，还要照常计时
+        clockstart();
+    }
+    rcuidle();   //停机时不会读RCU保护的数据
+    halt();   //开中断并停机，直到有中断到来
+    cli();
+    rcuquiesce();
+  }
+  c->idle = 0;
+  __sync_sub_and_fetch(&nidle, 1);
+  clockstart();
+  if(c != &cpus[0] && cpus[0].armed > 1)   //CPU 0还在无滴答地睡，叫醒它恢复计时
+    lapicipi(cpus[0].apicid, T_IRQ0 + IRQ_WAKE);
+  sti();
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run
-//  - swtch to start running that process
+//  - take the next process off this CPU's run queue,
+//    or steal one from another CPU if it is empty
+//  - swtch to start running that process, or halt in idle()
+//    if there is none
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
 void
@@ -326,38 +900,43 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  struct runq *rq = &runq[cpuid()];
   c->proc = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();    //允许中断
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);  //取锁
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){  //循环找一个RUNNABLE进程
-      if(p->state != RUNNABLE)
-        continue;
-
+    acquire(&rq->lock);  //取本CPU运行队列的锁
+    if((p = dequeue(rq, cpuid())) == 0){   //本CPU没有可运行的进程，去别的CPU偷一个
+      release(&rq->lock);
+      p = steal(cpuid());
+      acquire(&rq->lock);
+    }
+    if(p){
       // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
+      // to release rq->lock and then reacquire it
       // before jumping back to us.
       c->proc = p;   //此CPU准备运行p
       switchuvm(p);  //切换p进程页表
-      p->state = RUNNING;  //设置状态为RUNNING
 
       swtch(&(c->scheduler), p->context);  //切换进程
-      switchkvm();   //回来之后切换成内核页表
+      // Stay on p's page table rather than switching to
+      // kpgdir: if p runs next, its TLB entries survive.
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
       c->proc = 0;   //上个进程下CPU，此时CPU上没进程运行
     }
-    release(&ptable.lock);   //释放锁
-
+    if(p == 0)   //停机前不要占着已经退出的进程的页表
+      dropuvm();
+    release(&rq->lock);   //释放锁
+    if(p == 0)
+      idle();   //无事可做，停机等中断
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only this CPU's run queue lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -370,8 +949,8 @@ sched(void)   //让出CPU，重新调度
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))   
-    panic("sched ptable.lock");
+  if(!holding(&runq[cpuid()].lock))
+    panic("sched runq.lock");
   if(mycpu()->ncli != 1)       
     panic("sched locks");
   if(p->state == RUNNING)
@@ -379,6 +958,7 @@ sched(void)   //让出CPU，重新调度
   if(readeflags()&FL_IF)
     panic("sched interruptible");
   intena = mycpu()->intena;
+  rcuquiesce();   //切换上下文是RCU的静止状态
   swtch(&p->context, mycpu()->scheduler);
   mycpu()->intena = intena;
 }
@@ -387,20 +967,144 @@ sched(void)   //让出CPU，重新调度
 void
 yield(void)   //主动让出CPU
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct runq *rq;
+  struct proc *p = myproc();
+
+  rq = lockrunq();  //DOC: yieldlock
+  p->state = RUNNABLE;
+  enqueue(rq, p);   //排到本CPU运行队列的队尾
+  if(rq->n > 1)     //还有别的进程在等，让空闲的CPU来偷
+    wakecpu(cpuid());
   sched();
+  release(&runq[cpuid()].lock);
+}
+
+// Charge a timer tick to the current process, moving it down a
+// level once it has used up its time at this one.  Returns 1 if
+// it should yield the CPU: its slice is over, or a process of a
+// higher priority is waiting on this CPU.
+int
+schedtick(void)
+{
+  struct proc *p = myproc();
+  struct runq *rq;
+  int i, prio;
+
+  if(++p->ticks >= SLICE(p->prio)){   //本级别的时间片用完了，降级
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->ticks = 0;
+    return 1;
+  }
+  pushcli();
+  rq = &runq[cpuid()];
+  popcli();
+  prio = p->prio;
+  for(i = 0; i < prio; i++)   //不加锁看一眼有没有更高优先级的进程在等
+    if(rq->head[i])
+      return 1;
+  return 0;
+}
+
+// Put every process back at the level its nice value gives
+// it, with a fresh slice.  Called every BOOSTTICKS ticks.
+void
+prioboost(void)
+{
+  struct runq *rq;
+  struct proc *p, *q, *last;
+  int i;
+
+  for(rq = runq; rq < &runq[ncpu]; rq++){
+    acquire(&rq->lock);
+    // Chain the levels together, highest first, and queue
+    // the processes again at their new levels in that order.
+    q = last = 0;
+    for(i = 0; i < NPRIO; i++){
+      if(rq->head[i] == 0)
+        continue;
+      if(last)
+        last->next = rq->head[i];
+      else
+        q = rq->head[i];
+      last = rq->tail[i];
+      rq->head[i] = rq->tail[i] = 0;
+    }
+    rq->n = 0;
+    while((p = q) != 0){
+      q = p->next;
+      p->prio = BASEPRIO(p->nice);
+      p->ticks = 0;
+      enqueue(rq, p);
+    }
+    release(&rq->lock);
+  }
+  // The rest, sleeping or running, are not on any queue and
+  // can simply be given their new level.  (One that enqueue()
+  // is queueing meanwhile waits at its old level this once.)
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != RUNNABLE){
+      p->prio = BASEPRIO(p->nice);
+      p->ticks = 0;
+    }
+  }
   release(&ptable.lock);
 }
 
+// Add inc to the current process's nice value, keeping it
+// within [0, NICEMAX], and move it to the level that gives.
+// Returns the new nice value.
+int
+nice(int inc)
+{
+  struct proc *p = myproc();
+  int n;
+
+  n = p->nice + inc;
+  if(n < 0)
+    n = 0;
+  if(n > NICEMAX)
+    n = NICEMAX;
+  pushcli();   //时钟中断里的schedtick也会改prio
+  p->nice = n;
+  p->prio = BASEPRIO(n);
+  p->ticks = 0;
+  popcli();
+  return n;
+}
+
+// Return the scheduling level of process pid (the caller
+// if pid is 0), 0 being the highest, or -1 if there is no
+// such process.
+int
+getpriority(int pid)
+{
+  struct proc *p;
+  int prio;
+
+  if(pid == 0)
+    return myproc()->prio;
+  prio = -1;
+  rcureadlock();
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid == pid && p->state != UNUSED){
+      prio = p->prio;
+      break;
+    }
+  }
+  rcureadunlock();
+  return prio;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);  //解锁
+  // Still holding the run queue lock from scheduler.
+  release(&runq[cpuid()].lock);  //解锁
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -414,6 +1118,59 @@ forkret(void)
   // Return to "caller", actually trapret (see allocproc).
 }
 
+// Swap one user page out, for kswapd.  The clock hand sweeps
+// over the processes and their pages in turn (see swapscan()).
+// Only processes that are neither running nor in a system call
+// are candidates, since the kernel may be using the pages of
+// those directly; nor are threads, whose siblings may be.
+// Returns 0 once the page is on disk and its frame free, -1 if
+// no page or no swap slot was to be had.
+int
+swapout(void)
+{
+  static struct proc *hand = ptable.proc;
+  static uint va;
+  struct runq *rq;
+  struct proc *p;
+  char *mem;
+  int slot, n;
+
+  if((slot = swapalloc()) < 0)
+    return -1;
+  // ptable.lock keeps a sleeping process asleep, and the lock
+  // of the run queue it is on keeps a runnable one off the CPUs
+  // (and waits for either to finish switching out).
+  acquire(&ptable.lock);
+  // Twice round: the first time may only clear accessed bits.
+  for(n = 0; n <= 2*NPROC; n++){
+    p = hand;
+    mem = 0;
+    if((p->state == SLEEPING || p->state == RUNNABLE) && p->sz > 0 &&
+       nsharing(p->pgdir, p) == 0){   //线程可能正在别的CPU上用这些页
+      rq = &runq[p->cpu];
+      acquire(&rq->lock);
+      if(rq == &runq[p->cpu] && (p->state == SLEEPING || p->state == RUNNABLE) &&
+         !p->insyscall)
+        mem = swapscan(p, &va, slot);
+      release(&rq->lock);
+    }
+    if(mem){
+      release(&ptable.lock);
+      swapwrite(slot, mem);
+      swapdone(slot);
+      kfree(mem);
+      return 0;
+    }
+    va = 0;
+    if(++hand == &ptable.proc[NPROC])   //时钟指针转到下一个进程
+      hand = ptable.proc;
+  }
+  release(&ptable.lock);
+  swapfree(slot);
+  swapdone(slot);
+  return -1;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -428,7 +1185,7 @@ sleep(void *chan, struct spinlock *lk)
     panic("sleep without lk");
 
   // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
+  // change p->state to SLEEPING.
   // Once we hold ptable.lock, we can be
   // guaranteed that we won't miss any wakeup
   // (wakeup runs with ptable.lock locked),
@@ -439,29 +1196,51 @@ sleep(void *chan, struct spinlock *lk)
   }
   // Go to sleep.
 	p->chan = chan;    //休眠在chan上
+  p->chnext = ptable.sleepq[SLEEPQ(chan)];   //挂到chan对应的等待队列上
+  ptable.sleepq[SLEEPQ(chan)] = p;
   p->state = SLEEPING;  //状态更改为SLEEPING
 
+  // A wakeup may now come at any time, but it has to queue us
+  // on this CPU's run queue, whose lock we keep until the
+  // scheduler has switched away from us.
+  lockrunq();
+  release(&ptable.lock);
   sched();  //让出CPU调度
-  // Tidy up.
-  p->chan = 0;  //休眠对象改为0
+  release(&runq[cpuid()].lock);
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //如果lk不是ptable.lock
-    release(&ptable.lock); //释放ptable.lock
-    acquire(lk);   //重新获取lk锁
-  }
+  acquire(lk);   //重新获取lk锁
 }
 
 //PAGEBREAK!
+// Wake up at most n processes sleeping on chan, and return
+// how many there were.  The ptable lock must be held.
+static int
+wakeupn1(void *chan, int n)
+{
+  struct proc **pp, *p;
+  int woken;
+
+  woken = 0;
+  pp = &ptable.sleepq[SLEEPQ(chan)];
+  while(woken < n && (p = *pp) != 0){   //只看chan所在的那条等待队列
+    if(p->chan != chan){
+      pp = &p->chnext;
+      continue;
+    }
+    *pp = p->chnext;
+    p->chan = 0;
+    setrunnable(p);   //将其状态更改为RUNNABLE，放进运行队列
+    woken++;
+  }
+  return woken;
+}
+
 // Wake up all processes sleeping on chan.
 // The ptable lock must be held.
 static void wakeup1(void *chan)
 {
-  struct proc *p;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)  //寻找休眠状态且休眠在chan上的进程
-      p->state = RUNNABLE;   //将其状态更改为RUNNABLE
+  wakeupn1(chan, NPROC);
 }
 
 // Wake up all processes sleeping on chan.
@@ -473,32 +1252,57 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Wake up at most n processes sleeping on chan, for futex().
+int
+wakeupn(void *chan, int n)
+{
+  acquire(&ptable.lock);
+  n = wakeupn1(chan, n);
+  release(&ptable.lock);
+  return n;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
+// The search takes no lock: under RCU, p cannot be freed and
+// reused before we are done with it.  ptable.lock is taken only
+// to wake p if it is asleep.
 int kill(int pid)
 {
-  struct proc *p;
+  struct proc **pp, *p;
 
-  acquire(&ptable.lock);  //取锁
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){ //循环寻找pid号进程
-    if(p->pid == pid){  //找到了
-      p->killed = 1;   //killed置1
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)  //如果该进程在睡瞌睡
-        p->state = RUNNABLE;   //唤醒
-      release(&ptable.lock);  //放锁
-      return 0;   //返回正确
-    }
+  if(pid <= 0)   //槽位在释放中或空闲时pid为0
+    return -1;
+  rcureadlock();
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) //循环寻找pid号进程
+    if(p->pid == pid)
+      break;
+  if(p == &ptable.proc[NPROC]){
+    rcureadunlock();
+    return -1;   //返回错误
   }
-  release(&ptable.lock);  //放锁
-  return -1;   //返回错误
+  p->killed = 1;   //killed置1
+  rcureadunlock();
+
+  // Wake process from sleep if necessary.
+  acquire(&ptable.lock);
+  if(p->pid == pid && p->state == SLEEPING){  //如果该进程还是它，并且在睡瞌睡
+    for(pp = &ptable.sleepq[SLEEPQ(p->chan)]; *pp != p; pp = &(*pp)->chnext)
+      ;
+    *pp = p->chnext;   //从等待队列上摘下来
+    p->chan = 0;
+    setrunnable(p);   //唤醒
+  }
+  release(&ptable.lock);
+  return 0;   //返回正确
 }
 
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
-// No lock to avoid wedging a stuck machine further.
+// No lock to avoid wedging a stuck machine further, but under
+// RCU, so that the kernel stacks it looks at are not freed.
 void
 procdump(void)  //获取每个进程的状态，栈帧情况
 {
@@ -515,6 +1319,7 @@ procdump(void)  //获取每个进程的状态，栈帧情况
   char *state;
   uint pc[10];
 
+  rcureadlock();
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->state == UNUSED)
       continue;
@@ -530,4 +1335,5 @@ procdump(void)  //获取每个进程的状态，栈帧情况
     }
     cprintf("\n");
   }
+  rcureadunlock();
 }
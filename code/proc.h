@@ -8,6 +8,11 @@ struct cpu {
   int ncli;                    // 关中断深度
   int intena;                  // 该CPU在pushcli之前是否允许中断
   struct proc *proc;           // 运行在该CPU上的进程指针
+  pde_t *pgdir;                // Page directory in %cr3, holding a reference (0 until first switchkvm)
+  volatile uint armed;         // Ticks the LAPIC timer is armed for, 0 if stopped
+  volatile int idle;           // Halted in the scheduler with nothing to run
+  volatile int tlbflush;       // Asked by tlbshootdown() to flush the TLB
+  volatile uint rcuseen;       // RCU epoch it last passed a quiescent state in
 };
 
 extern struct cpu cpus[NCPU];
@@ -32,6 +37,20 @@ struct context {
   uint eip;
 };
 
+// A region of user memory whose pages are filled in on first
+// touch by pagefault() in vm.c.  The first filesz bytes come
+// from ip starting at offset off; the rest is zero fill.
+struct vma {
+  uint start;          // First address, page aligned
+  uint end;            // One past the last address (0 if slot unused)
+  struct inode *ip;    // Backing file, or 0 for zero fill
+  uint off;            // File offset of start
+  uint filesz;         // Bytes of the region backed by ip
+  int perm;            // PTE_U, plus PTE_W if writable
+  int flags;           // MAP_SHARED or MAP_PRIVATE for mmap(), 0 for exec()
+  struct shm *shm;     // Shared memory segment mapped here, or 0
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -45,9 +64,26 @@ struct proc {
   struct trapframe *tf;        // Trap frame for current syscall 中断栈帧指针
   struct context *context;     // swtch() here to run process 上下文指针
   void *chan;                  // If non-zero, sleeping on chan 用来睡眠
+  struct proc *chnext;         // Next sleeper in chan's hash chain 等待队列中的下一个进程
+  uint wakeat;                 // Tick to wake at, if on the timer wheel 定时唤醒的时刻
+  struct proc *tnext;          // Next on timer wheel slot
+  struct proc **tprev;         // Link pointing at us on the slot, 0 if not on the wheel
   int killed;                  // If non-zero, have been killed 是否被killed
-  struct file *ofile[NOFILE];  // Open files 打开文件描述符表
+  struct files *files;         // Open files, shared with threads 打开文件描述符表
+  struct file *fhold[NFHOLD];  // References fdget() took for this system call
+  int nfhold;
   struct inode *cwd;           // Current directory 当前工作路径
+  struct vma vma[NVMA];        // Demand-paged regions 按需调页的内存区域
+  int insyscall;               // In a system call: pages must stay resident 在系统调用中，页不能被换出
+  uint pinlo, pinhi;           // User memory this system call has faulted in, if pinhi 本次系统调用直接访问的用户内存
+  uint unmaplo, unmaphi;       // Range a sibling thread is unmapping, if unmaphi 别的线程正在解除映射的范围
+  uint ring;                   // User address of the submission ring, or 0 提交队列
+  struct cpu *lastcpu;         // CPU whose TLB may hold our mappings; 0 forces a flush
+  int cpu;                     // Run queue we are on, or CPU we run on 所在运行队列/CPU
+  struct proc *next;           // Next on run queue 运行队列中的下一个进程
+  int nice;                    // 0..NICEMAX; higher starts at a lower level
+  int prio;                    // Current MLFQ level, 0 highest 当前优先级
+  int ticks;                   // Ticks used at this level 本级别已用的时间片
   char name[16];               // Process name (debugging) 进程名字
 };
 
@@ -0,0 +1,134 @@
+// Read-copy update, epoch based.
+//
+// Readers look things up without taking locks, between
+// rcureadlock() and rcureadunlock(), which only keep the CPU from
+// taking interrupts or switching away; they must not sleep.  A
+// writer unpublishes an object, e.g. clears the key it is found
+// by, and hands callrcu() a function that frees it for good,
+// which runs once every CPU has passed a quiescent state, where
+// it cannot be in the middle of a lookup.
+//
+// Quiescent states are context switches (sched()), timer
+// interrupts, which cannot arrive inside a lookup, and halting in
+// idle().  Each CPU notes in rcuseen the epoch it last passed one
+// in; once all have seen the current epoch, rcutick() starts the
+// next.  A callback queued in epoch e runs in epoch e+2: by then
+// every CPU has passed a quiescent state after the epoch moved on
+// from e, so after the object was unpublished.  Callbacks run
+// from the timer interrupt, with no locks held.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "rcu.h"
+
+#define RCUIDLE 0xFFFFFFFF   // rcuseen of a halted CPU, quiescent for good
+
+static struct {
+  struct spinlock lock;
+  volatile uint epoch;
+  struct rcuhead *head;      // Callbacks, oldest first
+  struct rcuhead **tail;
+} rcu;
+
+void
+rcuinit(void)
+{
+  initlock(&rcu.lock, "rcu");
+  rcu.epoch = 1;
+  rcu.tail = &rcu.head;
+}
+
+// Start a lookup.
+void
+rcureadlock(void)
+{
+  pushcli();
+}
+
+void
+rcureadunlock(void)
+{
+  popcli();
+}
+
+// This CPU is at a quiescent state.  Interrupts must be off.
+void
+rcuquiesce(void)
+{
+  mycpu()->rcuseen = rcu.epoch;
+}
+
+// This CPU is about to halt, and stays quiescent until
+// rcuquiesce().  Interrupts must be off.
+void
+rcuidle(void)
+{
+  mycpu()->rcuseen = RCUIDLE;
+}
+
+// Run fn(arg) once all lookups going on now are over.
+void
+callrcu(struct rcuhead *h, void (*fn)(void*), void *arg)
+{
+  h->fn = fn;
+  h->arg = arg;
+  h->next = 0;
+  acquire(&rcu.lock);
+  h->epoch = rcu.epoch;
+  *rcu.tail = h;   //挂到队尾
+  rcu.tail = &h->next;
+  release(&rcu.lock);
+}
+
+// Whether callbacks are waiting, so that the clock must keep
+// ticking for rcutick().
+int
+rcupending(void)
+{
+  return rcu.head != 0;
+}
+
+// Timer interrupt: note the quiescent state, start the next
+// epoch if every CPU has seen this one, and run the callbacks
+// whose grace period is over.
+void
+rcutick(void)
+{
+  struct rcuhead *h, *done, **donetail;
+  uint e, seen;
+  int i;
+
+  rcuquiesce();
+  if(rcu.head == 0)
+    return;
+
+  acquire(&rcu.lock);
+  e = rcu.epoch;
+  for(i = 0; i < ncpu; i++){
+    seen = cpus[i].rcuseen;
+    if(cpus[i].started && seen != RCUIDLE && seen != e)
+      break;
+  }
+  if(i == ncpu)   //所有CPU都经过了静止状态，进入下一个周期
+    rcu.epoch = ++e;
+  done = 0;
+  donetail = &done;
+  while((h = rcu.head) != 0 && e - h->epoch >= 2){   //宽限期已过
+    rcu.head = h->next;
+    *donetail = h;
+    donetail = &h->next;
+  }
+  *donetail = 0;
+  if(rcu.head == 0)
+    rcu.tail = &rcu.head;
+  release(&rcu.lock);
+
+  while((h = done) != 0){
+    done = h->next;
+    h->fn(h->arg);
+  }
+}
@@ -0,0 +1,8 @@
+// A callback queued with callrcu(), to run once no CPU can still
+// be reading what the caller unpublished.
+struct rcuhead {
+  struct rcuhead *next;
+  void (*fn)(void*);
+  void *arg;
+  uint epoch;          // Epoch it was queued in 在哪个周期挂上的
+};
@@ -0,0 +1,95 @@
+//
+// Submission rings: batches of system calls for one trap.
+//
+// A process registers a struct ring in its own memory with
+// ringsetup() and then queues read, write, open, close and fstat
+// calls in it.  ringenter() runs the queued calls in order and
+// posts their results, all in one trap, so that a loop of reads
+// and writes costs a kernel entry per batch instead of per call.
+//
+// Each call reads its arguments straight out of its sqe, through
+// syscallat(), with the same checks as when made directly.  A
+// RING_LINK chain stops at the first call that fails: the rest
+// of the chain completes with -1 without running.  RING_FDPREV
+// and RING_NPREV write the previous call's result into the sqe
+// before it runs, so a chain can read into a buffer and write out
+// what it got, or open a file and go on to use the descriptor.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "syscall.h"
+#include "ring.h"
+
+// The calls a ring may carry.  Those that change the address
+// space or the process itself are left out.
+static int
+ringop(int op)
+{
+  switch(op){
+  case SYS_read:
+  case SYS_write:
+  case SYS_open:
+  case SYS_close:
+  case SYS_fstat:
+    return 1;
+  }
+  return 0;
+}
+
+// Use the ring at user address addr, or none if addr is 0.
+int
+ringsetup(uint addr)
+{
+  if(addr && (addr % sizeof(int) || prefault(addr, sizeof(struct ring), 1) < 0))
+    return -1;
+  myproc()->ring = addr;
+  return 0;
+}
+
+// Run up to n queued calls, stopping early if the queue runs
+// dry or the completion ring fills up.  Returns how many ran,
+// or -1 if there is no ring.
+int
+ringenter(int n)
+{
+  struct proc *p = myproc();
+  struct ring *r;
+  struct sqe *e;
+  int i, op, flags, prev, failed;
+  uint data;
+
+  if(p->ring == 0 || prefault(p->ring, sizeof(*r), 1) < 0)   //进程可能已经缩小了内存
+    return -1;
+  r = (struct ring*)p->ring;
+  prev = 0;
+  failed = 0;   //本链中已经有调用失败了
+  for(i = 0; i < n; i++){
+    if(r->sqhead == r->sqtail || r->cqtail - r->cqhead >= NRING)
+      break;
+    e = &r->sq[r->sqhead % NRING];
+    op = e->op;
+    flags = e->flags;
+    data = e->data;
+    if(flags & RING_FDPREV)
+      e->arg[0] = prev;
+    if(flags & RING_NPREV)
+      e->arg[2] = prev;
+    if(failed || !ringop(op))
+      prev = -1;
+    else
+      prev = syscallat(op, (uint)e->arg);   //参数就在队列项里
+    if(p->killed)
+      break;
+    failed = (flags & RING_LINK) && (failed || prev < 0);
+    r->cq[r->cqtail % NRING].data = data;
+    r->cq[r->cqtail % NRING].res = prev;
+    __sync_synchronize();   //先写好完成项，再让进程看到
+    r->cqtail++;
+    r->sqhead++;
+  }
+  return i;
+}
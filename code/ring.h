@@ -0,0 +1,37 @@
+// Submission and completion rings, for ringsetup() and ringenter().
+//
+// A process queues system calls in sq and advances sqtail;
+// ringenter() runs the entries from sqhead on, one after
+// another, and posts what each returned in cq at cqtail.  The
+// process reaps completions from cqhead on without entering
+// the kernel.  Indices run freely; entry i is at i % NRING.
+
+#define NRING 32   // Entries in each ring, a power of two
+
+// sqe flags
+#define RING_LINK   0x1   // Run the next entry only if this one does not fail
+#define RING_FDPREV 0x2   // Use the previous entry's result as arg[0]
+#define RING_NPREV  0x4   // Use the previous entry's result as arg[2]
+
+// A queued system call: op is SYS_read, SYS_write, SYS_open,
+// SYS_close or SYS_fstat, and arg holds its arguments in order.
+struct sqe {
+  int op;
+  int flags;
+  uint data;    // Handed back in the completion
+  int arg[3];
+};
+
+struct cqe {
+  uint data;
+  int res;      // What the call returned; -1 if it was not run
+};
+
+struct ring {
+  volatile uint sqhead;   // Next entry to run; the kernel advances it
+  volatile uint sqtail;   // Next free entry; the process advances it
+  volatile uint cqhead;   // Next completion to reap; the process advances it
+  volatile uint cqtail;   // Next free completion; the kernel advances it
+  struct sqe sq[NRING];
+  struct cqe cq[NRING];
+};
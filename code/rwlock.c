@@ -0,0 +1,145 @@
+// Reader-writer spin locks and sequence locks, for data that is
+// read far more often than it is changed.
+//
+// A reader-writer lock lets any number of CPUs read at once.  A
+// writer that finds readers sets RW_WAITING, which keeps new
+// readers out until it is done, so a stream of readers cannot
+// starve it.  Readers must therefore not take a read lock they
+// already hold: with a writer waiting in between, they would
+// wait for themselves.
+//
+// A sequence lock costs readers no writes at all: a reader reads
+// the data between seqreadbegin() and seqreadretry(), and reads
+// again if a writer changed the sequence number meanwhile.  It
+// suits small data, such as a counter, that is cheap to reread.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "mmu.h"
+#include "proc.h"
+#include "rwlock.h"
+
+#define RW_WRITER   0x80000000
+#define RW_WAITING  0x40000000
+#define RW_READERS  0x3FFFFFFF
+
+void
+initrwlock(struct rwlock *lk, char *name)
+{
+  lk->name = name;
+  lk->state = 0;
+  lk->cpu = 0;
+}
+
+void
+acquireread(struct rwlock *lk)
+{
+  uint s;
+
+  pushcli();   //关中断，防止中断处理程序来取同一把锁
+  for(;;){
+    s = lk->state;
+    if((s & (RW_WRITER|RW_WAITING)) == 0 && cmpxchg(&lk->state, s, s+1) == s)
+      break;
+    pause();
+  }
+  __sync_synchronize();
+}
+
+void
+releaseread(struct rwlock *lk)
+{
+  if((lk->state & RW_READERS) == 0)
+    panic("releaseread");
+  __sync_synchronize();
+  xadd(&lk->state, -1);   //读者数减一
+  popcli();
+}
+
+void
+acquirewrite(struct rwlock *lk)
+{
+  uint s;
+
+  pushcli();
+  if(holdingwrite(lk))
+    panic("acquirewrite");
+  for(;;){
+    s = lk->state;
+    if((s & ~RW_WAITING) == 0){   //没有读者也没有写者
+      if(cmpxchg(&lk->state, s, RW_WRITER) == s)
+        break;
+    } else if((s & RW_WAITING) == 0)
+      cmpxchg(&lk->state, s, s | RW_WAITING);   //挡住后来的读者
+    pause();
+  }
+  __sync_synchronize();
+  lk->cpu = mycpu();
+}
+
+void
+releasewrite(struct rwlock *lk)
+{
+  uint s;
+
+  if(!holdingwrite(lk))
+    panic("releasewrite");
+  lk->cpu = 0;
+  __sync_synchronize();
+  do
+    s = lk->state;
+  while(cmpxchg(&lk->state, s, s & ~RW_WRITER) != s);   //别的写者可能刚设了RW_WAITING
+  popcli();
+}
+
+// Check whether this cpu holds lk for writing.
+int
+holdingwrite(struct rwlock *lk)
+{
+  int r;
+
+  pushcli();
+  r = (lk->state & RW_WRITER) && lk->cpu == mycpu();
+  popcli();
+  return r;
+}
+
+// Start changing the data that sl protects.  The caller must
+// hold the lock that keeps writers apart.
+void
+seqwritebegin(struct seqlock *sl)
+{
+  sl->seq++;   //变成奇数
+  __sync_synchronize();
+}
+
+void
+seqwriteend(struct seqlock *sl)
+{
+  __sync_synchronize();
+  sl->seq++;   //变回偶数
+}
+
+// Start reading the data that sl protects.  Returns the
+// sequence number to hand to seqreadretry().
+uint
+seqreadbegin(struct seqlock *sl)
+{
+  uint seq;
+
+  while((seq = sl->seq) & 1)   //有写者正在改，等它改完
+    pause();
+  __sync_synchronize();
+  return seq;
+}
+
+// Whether the data read since seqreadbegin() returned seq may
+// have been changed meanwhile, and must be read again.
+int
+seqreadretry(struct seqlock *sl, uint seq)
+{
+  __sync_synchronize();
+  return sl->seq != seq;
+}
@@ -0,0 +1,13 @@
+// Reader-writer spin lock.  Any number of readers, or one writer.
+struct rwlock {
+  volatile uint state;  // RW_WRITER | RW_WAITING | number of readers
+  char *name;           // Name of lock. 名字
+  struct cpu *cpu;      // The cpu holding it for writing 哪个CPU在写
+};
+
+// Sequence lock: readers never wait for or write to the lock,
+// but retry if a writer was at work meanwhile.  Writers are
+// kept apart by some other lock.
+struct seqlock {
+  volatile uint seq;    // Odd while a writer is at work 奇数表示正在写
+};
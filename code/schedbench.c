@@ -0,0 +1,73 @@
+// Scheduler benchmark.  Starts a number of CPU hogs, half of
+// them niced, and meanwhile measures how long a process that
+// sleeps for one tick at a time waits for the CPU after each
+// wakeup.  With the feedback queue the sleeper should stay at
+// the top level and run as soon as it wakes, while the hogs
+// sink to the bottom and still share the rest of the CPU.
+//
+// usage: schedbench [hogs]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define ROUNDS 200
+
+int
+main(int argc, char *argv[])
+{
+  int nhog, i, pid, fds[2], end, start, late, worst, t, n, count;
+
+  nhog = 4;
+  if(argc > 1)
+    nhog = atoi(argv[1]);
+  if(nhog < 0 || pipe(fds) < 0){
+    printf(2, "usage: schedbench [hogs]\n");
+    exit();
+  }
+
+  end = uptime() + ROUNDS + 50;
+  for(i = 0; i < nhog; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(2, "schedbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(fds[0]);
+      if(i % 2)
+        nice(10);
+      count = 0;
+      while(uptime() < end)
+        count++;
+      printf(1, "hog %d: nice %d, level %d, %d loops\n",
+             i, i % 2 ? 10 : 0, getpriority(0), count);
+      write(fds[1], &count, sizeof(count));
+      exit();
+    }
+  }
+  close(fds[1]);
+
+  // Let the hogs use up their slices first.
+  sleep(10);
+
+  late = worst = 0;
+  for(i = 0; i < ROUNDS; i++){
+    start = uptime();
+    sleep(1);
+    t = uptime() - start - 1;
+    late += t;
+    if(t > worst)
+      worst = t;
+  }
+  printf(1, "sleeper: level %d, %d wakeups, %d ticks late in all, worst %d\n",
+         getpriority(0), ROUNDS, late, worst);
+
+  n = 0;
+  while(read(fds[0], &count, sizeof(count)) == sizeof(count))
+    n++;
+  for(i = 0; i < nhog; i++)
+    wait();
+  printf(1, "schedbench: %d of %d hogs finished\n", n, nhog);
+  exit();
+}
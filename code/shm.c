@@ -0,0 +1,131 @@
+//
+// Named shared memory segments.
+//
+// A segment is a set of physical pages with a name.  Every
+// process that attaches it maps the very same pages, so data
+// written by one process is seen by the others without being
+// copied, unlike with a pipe.  The segment is freed when the
+// last mapping of it goes away: by shmdetach(), exit() or exec().
+// fork() gives the child its own reference.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+
+struct shm {
+  char name[SHMNAME];
+  int ref;                  // Number of mappings; 0 if slot is free
+  int npages;
+  char *pages[SHMPAGES];    // Kernel addresses of the pages
+};
+
+struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+} shmtable;   //共享内存段表
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shmtable");
+}
+
+// Find the segment called name.  Caller holds shmtable.lock.
+static struct shm*
+shmlookup(char *name)
+{
+  struct shm *s;
+
+  for(s = shmtable.shm; s < &shmtable.shm[NSHM]; s++)
+    if(s->ref > 0 && strncmp(s->name, name, SHMNAME) == 0)
+      return s;
+  return 0;
+}
+
+// Attach the segment called name to the current process,
+// first creating it with size bytes of zeroed memory if create
+// is set (it must not exist yet).  Returns the address the
+// segment is mapped at, or -1.
+int
+shmattach(char *uname, int size, int create)
+{
+  char name[SHMNAME];
+  struct shm *s;
+  int i, addr;
+
+  if(strlen(uname) >= SHMNAME)
+    return -1;
+  safestrcpy(name, uname, SHMNAME);   //名字在用户内存里，先拷进内核
+
+  acquire(&shmtable.lock);
+  s = shmlookup(name);
+  if(create){
+    if(s != 0 || size <= 0 || PGROUNDUP(size) / PGSIZE > SHMPAGES){
+      release(&shmtable.lock);
+      return -1;
+    }
+    for(s = shmtable.shm; s < &shmtable.shm[NSHM]; s++)
+      if(s->ref == 0)
+        break;
+    if(s == &shmtable.shm[NSHM]){
+      release(&shmtable.lock);
+      return -1;
+    }
+    s->npages = PGROUNDUP(size) / PGSIZE;
+    for(i = 0; i < s->npages; i++){   //段自己持有每一页的一个引用
+      if((s->pages[i] = kalloc()) == 0){
+        while(--i >= 0)
+          kfree(s->pages[i]);
+        release(&shmtable.lock);
+        return -1;
+      }
+      memset(s->pages[i], 0, PGSIZE);
+    }
+    safestrcpy(s->name, name, SHMNAME);
+  } else if(s == 0){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->ref++;   //先占住引用，映射时段不会被别人释放
+  release(&shmtable.lock);
+
+  if((addr = mapshm(s, s->pages, s->npages)) < 0){
+    shmput(s);
+    return -1;
+  }
+  return addr;
+}
+
+// Record one more mapping of s (fork).
+void
+shmdup(struct shm *s)
+{
+  acquire(&shmtable.lock);
+  if(s->ref < 1)
+    panic("shmdup");
+  s->ref++;
+  release(&shmtable.lock);
+}
+
+// Drop a mapping of s; the last one frees the pages.
+// The mapping's own page references are dropped separately,
+// when its page table entries are freed.
+void
+shmput(struct shm *s)
+{
+  int i;
+
+  acquire(&shmtable.lock);
+  if(s->ref < 1)
+    panic("shmput");
+  if(--s->ref == 0){
+    for(i = 0; i < s->npages; i++)
+      kfree(s->pages[i]);
+    s->npages = 0;
+    s->name[0] = 0;
+  }
+  release(&shmtable.lock);
+}
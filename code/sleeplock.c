@@ -1,4 +1,12 @@
 // Sleeping locks
+//
+// A sleep lock is held either by one process, with
+// acquiresleep(), or shared by any number of readers, with
+// acquiresleepread().  A process waiting to hold it alone keeps
+// new readers out, so that readers cannot starve it.  So shared
+// holds must not nest: a process that already holds lk shared
+// and asks for it again would wait behind such a writer, which
+// waits for it in turn.
 
 #include "types.h"
 #include "defs.h"
@@ -9,6 +17,7 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "lockstat.h"
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -16,18 +25,37 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");   //初始化自旋锁
   lk->name = name;   //名字
   lk->locked = 0;    //初始化未上锁
+  lk->readers = 0;
+  lk->writers = 0;
   lk->pid = 0;       //初始化没有进程取该锁
+  lk->class = LOCKSTAT ? lockclass(name, 1) : 0;
 }
 
 void acquiresleep(struct sleeplock *lk)
 {
+  uint64 t0;
+  uint pcs[10];
+  int waited;
+
   acquire(&lk->lk);        //优先级:->高于&
     
-  while (lk->locked) {    //当锁已被其他进程取走
+  t0 = LOCKSTAT ? rdtsc() : 0;
+  waited = lk->locked || lk->readers;
+  lk->writers++;
+  while (lk->locked || lk->readers) {    //当锁已被其他进程取走
     sleep(lk, &lk->lk);   //休眠
   }
+  lk->writers--;
   lk->locked = 1;        //上锁
   lk->pid = myproc()->pid;  //取锁进程的pid
+
+  if(LOCKSTAT && lk->class){
+    lk->tacquire = rdtsc();
+    pcs[0] = 0;
+    if(waited)
+      getcallerpcs(&lk, pcs);   //谁在等
+    lockcount(lk->class, pcs[0], lk->tacquire - t0);
+  }
     
   release(&lk->lk);       
 }
@@ -35,12 +63,52 @@ void acquiresleep(struct sleeplock *lk)
 void releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);  //取自旋锁
+  if(LOCKSTAT && lk->class)
+    lockheld(lk->class, rdtsc() - lk->tacquire);
   lk->locked = 0;
   lk->pid = 0;
   wakeup(lk);        //唤醒
   release(&lk->lk);
 }
 
+// Acquire lk shared with other readers.  The caller must not
+// hold lk already, even shared.
+void
+acquiresleepread(struct sleeplock *lk)
+{
+  uint64 t0;
+  uint pcs[10];
+  int waited;
+
+  acquire(&lk->lk);
+  t0 = LOCKSTAT ? rdtsc() : 0;
+  waited = lk->locked || lk->writers;
+  while (lk->locked || lk->writers) {   //有人独占或在等着独占
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+
+  if(LOCKSTAT && lk->class){
+    pcs[0] = 0;
+    if(waited)
+      getcallerpcs(&lk, pcs);
+    lockcount(lk->class, pcs[0], rdtsc() - t0);
+  }
+
+  release(&lk->lk);
+}
+
+void
+releasesleepread(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers == 0)
+    panic("releasesleepread");
+  if(--lk->readers == 0)   //最后一个读者，叫醒等着独占的进程
+    wakeup(lk);
+  release(&lk->lk);
+}
+
 int
 holdingsleep(struct sleeplock *lk)   //是否有进程取得了该锁
 {
@@ -1,10 +1,16 @@
-// Long-term locks for processes
+// Long-term locks for processes, held alone or shared by readers
 struct sleeplock {
   uint locked;       // Is the lock held? 已锁？
+  uint readers;      // Number of processes sharing it 共享持有的读者数
+  uint writers;      // Processes waiting to hold it alone 等着独占的进程数
   struct spinlock lk; // spinlock protecting this sleep lock 自旋锁
   
   // For debugging:
   char *name;        // Name of lock. 名字
   int pid;           // Process holding lock 哪个进程持有？
+
+  // For getlockstat() (LOCKSTAT):
+  struct lockclass *class;  // Statistics shared by locks of this name
+  uint64 tacquire;          // When it was acquired (TSC) 取锁时刻
 };
 
@@ -1,4 +1,16 @@
 // Mutual exclusion spin locks.
+//
+// With TICKETLOCK (param.h) a CPU takes a ticket with one atomic
+// add and then only reads owner until its number comes up, so
+// waiters get the lock in the order they asked for it and do not
+// keep bouncing the lock's cache line between them with locked
+// writes.  Without it, acquire() spins on xchg as it used to.
+//
+// With LOCKSTAT, every lock also counts how often it was taken,
+// how often and how long CPUs had to wait for it, who they were
+// and the longest it was held, for getlockstat().  Locks with the
+// same name share one set of counters, a lock class, and each CPU
+// keeps its own counters in it so that counting needs no lock.
 
 #include "types.h"
 #include "defs.h"
@@ -8,12 +20,26 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+struct lockclass {
+  char name[16];
+  int sleep;
+  struct lockstat cpu[NCPU];   //每个CPU只改自己的那份，不用加锁
+};
+
+static struct lockclass lockclasses[NLOCKCLASS];
+static int nlockclass;
+static uint classlock;   //initlock()可能在mycpu()能用之前就被调用，只能用xchg
 
 void initlock(struct spinlock *lk, char *name)  //初始化锁 lk
 {
   lk->name = name;   //初始化该锁的名字
   lk->locked = 0;    //初始化该锁空闲
   lk->cpu = 0;       //初始化持有该锁的CPU为空
+  lk->next = 0;
+  lk->owner = 0;
+  lk->class = LOCKSTAT ? lockclass(name, 0) : 0;
 }
 
 // Acquire the lock.
@@ -23,13 +49,32 @@ void initlock(struct spinlock *lk, char *name)  //初始化锁 lk
 void
 acquire(struct spinlock *lk)
 {
+  uint64 t0;
+  int waited;
+#if TICKETLOCK
+  uint t;
+#endif
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))   // 如果已经取了锁
     panic("acquire");
 
+  t0 = LOCKSTAT ? rdtsc() : 0;
+  waited = 0;
+#if TICKETLOCK
+  t = xadd(&lk->next, 1);   //取号
+  while(*(volatile uint*)&lk->owner != t){   //只读，等叫到自己的号
+    waited = 1;
+    pause();
+  }
+  lk->locked = 1;
+#else
   // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)   //原子赋值
-    ;
+  while(xchg(&lk->locked, 1) != 0){   //原子赋值
+    waited = 1;
+    pause();
+  }
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +85,11 @@ acquire(struct spinlock *lk)
   // 调试信息
   lk->cpu = mycpu();     //记录当前取锁的CPU
   getcallerpcs(&lk, lk->pcs);   //获取调用栈信息
+
+  if(LOCKSTAT && lk->class){
+    lk->tacquire = rdtsc();
+    lockcount(lk->class, waited ? lk->pcs[0] : 0, lk->tacquire - t0);
+  }
 }
 
 // Release the lock.
@@ -49,6 +99,8 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  if(LOCKSTAT && lk->class)
+    lockheld(lk->class, rdtsc() - lk->tacquire);
   lk->pcs[0] = 0;  //清除调试信息
   lk->cpu = 0;
 
@@ -63,6 +115,11 @@ release(struct spinlock *lk)
   // This code can't use a C assignment, since it might
   // not be atomic. A real OS would use C atomics here.
   asm volatile("movl $0, %0" : "+m" (lk->locked) : ); //lk->locked=0
+#if TICKETLOCK
+  // Only the holder writes owner, so a plain store hands the
+  // lock to the next ticket.
+  asm volatile("incl %0" : "+m" (lk->owner) : ); //叫下一个号
+#endif
 
   popcli();
 }
@@ -120,3 +177,125 @@ void popcli(void)
     sti();
 }
 
+
+// The class for locks named name: sleep locks if sleep is set,
+// spinlocks otherwise.  Returns 0 once all NLOCKCLASS are taken.
+struct lockclass*
+lockclass(char *name, int sleep)
+{
+  struct lockclass *c;
+  int eflags, i;
+
+  if(name == 0)
+    return 0;
+  eflags = readeflags();
+  cli();
+  while(xchg(&classlock, 1) != 0)
+    pause();
+  c = 0;
+  for(i = 0; i < nlockclass; i++){
+    if(lockclasses[i].sleep == sleep &&
+       strncmp(lockclasses[i].name, name, sizeof(c->name)-1) == 0){
+      c = &lockclasses[i];
+      break;
+    }
+  }
+  if(c == 0 && nlockclass < NLOCKCLASS){   //新的名字，开一个类
+    c = &lockclasses[nlockclass];
+    safestrcpy(c->name, name, sizeof(c->name));
+    c->sleep = sleep;
+    nlockclass++;
+  }
+  xchg(&classlock, 0);
+  if(eflags & FL_IF)
+    sti();
+  return c;
+}
+
+// Count n more waits by caller pc in s, keeping the NLOCKPC
+// callers seen most.  A caller that is new takes over the slot
+// of the least frequent one together with its count, so counts
+// may be too high but a caller that waits often is not missed.
+static void
+countpc(struct lockstat *s, uint pc, uint n)
+{
+  int i, min;
+
+  min = 0;
+  for(i = 0; i < NLOCKPC; i++){
+    if(s->pc[i] == pc)
+      break;
+    if(s->npc[i] < s->npc[min])
+      min = i;
+  }
+  if(i == NLOCKPC){
+    i = min;
+    s->pc[i] = pc;
+  }
+  s->npc[i] += n;
+}
+
+// A lock of class c has been acquired.  If the caller at pc had
+// to wait for it, pc is not 0 and the wait took wait cycles.
+// Interrupts must be off.
+void
+lockcount(struct lockclass *c, uint pc, uint64 wait)
+{
+  struct lockstat *s = &c->cpu[cpuid()];
+
+  s->nacquire++;
+  if(pc){
+    s->ncontend++;
+    s->wait += wait;
+    countpc(s, pc, 1);
+  }
+}
+
+// A lock of class c was held for held cycles.
+// Interrupts must be off.
+void
+lockheld(struct lockclass *c, uint64 held)
+{
+  struct lockstat *s = &c->cpu[cpuid()];
+
+  if(held > s->maxhold)
+    s->maxhold = held;
+}
+
+// Copy the statistics of up to n lock classes to user address
+// addr, adding up the counts of all CPUs, and clear them all if
+// reset is set.  Returns the number of classes copied, or -1.
+int
+getlockstat(uint addr, int n, int reset)
+{
+  struct lockclass *c;
+  struct lockstat ls, *s;
+  int i, j, k, copied;
+
+  copied = 0;
+  for(i = 0; i < nlockclass; i++){
+    c = &lockclasses[i];
+    if(i < n){
+      memset(&ls, 0, sizeof(ls));
+      safestrcpy(ls.name, c->name, sizeof(ls.name));
+      ls.sleep = c->sleep;
+      for(j = 0; j < ncpu; j++){
+        s = &c->cpu[j];
+        ls.nacquire += s->nacquire;
+        ls.ncontend += s->ncontend;
+        ls.wait += s->wait;
+        if(s->maxhold > ls.maxhold)
+          ls.maxhold = s->maxhold;
+        for(k = 0; k < NLOCKPC; k++)
+          if(s->npc[k])
+            countpc(&ls, s->pc[k], s->npc[k]);
+      }
+      if(copyout(myproc()->pgdir, addr + i*sizeof(ls), &ls, sizeof(ls)) < 0)
+        return -1;
+      copied++;
+    }
+    if(reset)   //别的CPU可能同时在改，清零前后有几次计数会丢，无妨
+      memset(c->cpu, 0, sizeof(c->cpu));
+  }
+  return copied;
+}
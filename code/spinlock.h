@@ -1,11 +1,17 @@
 // Mutual exclusion lock.
 struct spinlock {
   uint locked;       // Is the lock held? 该锁是否被锁上了
+  uint next;         // Next ticket to hand out (TICKETLOCK) 下一张票号
+  uint owner;        // Ticket now being served (TICKETLOCK) 正在服务的票号
 
   // For debugging:
   char *name;        // Name of lock. 名字
   struct cpu *cpu;   // The cpu holding the lock. 哪个CPU取了锁
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock. 调用栈信息
+
+  // For getlockstat() (LOCKSTAT):
+  struct lockclass *class;  // Statistics shared by locks of this name
+  uint64 tacquire;          // When it was acquired (TSC) 取锁时刻
 };
 
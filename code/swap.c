@@ -0,0 +1,212 @@
+//
+// Swapping of user pages to the swap area that mkfs lays out
+// on the disk after the file system (sb.swapstart, sb.nswap).
+//
+// kswapd, a kernel process, keeps at least SWAPLOW pages free:
+// it picks victims with the clock (second-chance) algorithm in
+// swapout(), writes them to a free slot and leaves the slot
+// number in the PTE, marked PTE_SWAP instead of PTE_P.  The next
+// access faults, and pagefault() reads the page back in with
+// swapin().  A process that finds no free memory waits in
+// swapwait() for kswapd to make some.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+
+#define BPP (PGSIZE/BSIZE)   // disk blocks per page
+
+struct {
+  struct spinlock lock;
+  uint start;               // First block of the swap area
+  int nslot;                // Pages that fit in it; 0 until kswapd starts
+  uchar used[SWAPSIZE/BPP]; // Slot holds a page
+  uchar busy[SWAPSIZE/BPP]; // Slot is still being written out
+  uint freed;               // Pages freed by kswapd so far
+  int wanted;               // Someone is waiting in swapwait()
+  int stuck;                // Nothing left to swap out
+} swap;
+
+// Private buffer for swap I/O, which bypasses the buffer cache.
+static struct buf swapbuf;
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swapbuf.lock, "swapbuf");
+}
+
+// Allocate a free slot, marked busy until swapdone().
+// Returns -1 if the swap area is full.
+int
+swapalloc(void)
+{
+  int i;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    if(!swap.used[i] && !swap.busy[i]){
+      swap.used[i] = 1;
+      swap.busy[i] = 1;
+      release(&swap.lock);
+      return i;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// The page has been written to slot.
+void
+swapdone(int slot)
+{
+  acquire(&swap.lock);
+  swap.busy[slot] = 0;
+  release(&swap.lock);
+  wakeup(&swap.busy[slot]);
+}
+
+// Free slot.  Does not take swap.lock, which sleepers hold
+// while acquiring ptable.lock: wait() frees the pages of a
+// zombie, slots included, with ptable.lock held.  Only the
+// owner of a slot clears its byte, and the store is atomic.
+void
+swapfree(int slot)
+{
+  if(slot < 0 || slot >= swap.nslot)
+    panic("swapfree");
+  __sync_synchronize();
+  swap.used[slot] = 0;
+}
+
+// Read or write the page at mem from or to slot.
+static void
+swaprw(int slot, char *mem, int write)
+{
+  int i;
+
+  acquiresleep(&swapbuf.lock);
+  for(i = 0; i < BPP; i++){
+    swapbuf.dev = ROOTDEV;
+    swapbuf.blockno = swap.start + slot*BPP + i;
+    if(write){
+      memmove(swapbuf.data, mem + i*BSIZE, BSIZE);
+      swapbuf.flags = B_DIRTY;
+    } else
+      swapbuf.flags = 0;
+    iderw(&swapbuf);
+    if(!write)
+      memmove(mem + i*BSIZE, swapbuf.data, BSIZE);
+  }
+  releasesleep(&swapbuf.lock);
+}
+
+void
+swapwrite(int slot, char *mem)
+{
+  swaprw(slot, mem, 1);
+}
+
+// Read the page in slot into mem, first waiting for it
+// to have been written out if that is still going on.
+void
+swapread(int slot, char *mem)
+{
+  if(slot < 0 || slot >= swap.nslot)
+    panic("swapread");
+  acquire(&swap.lock);
+  while(swap.busy[slot])
+    sleep(&swap.busy[slot], &swap.lock);
+  release(&swap.lock);
+  swaprw(slot, mem, 0);
+}
+
+// Called when kalloc() has failed: ask kswapd for memory and
+// wait until it has freed some.  Returns -1 if it cannot
+// (no swap, or nothing left to swap out), or if the caller
+// has been killed meanwhile.
+int
+swapwait(void)
+{
+  uint freed;
+
+  acquire(&swap.lock);
+  if(swap.nslot == 0 || swap.stuck){
+    release(&swap.lock);
+    return -1;
+  }
+  freed = swap.freed;
+  swap.wanted = 1;
+  wakeup(&swap.wanted);   //叫醒kswapd
+  while(swap.freed == freed && !swap.stuck && !myproc()->killed)
+    sleep(&swap.freed, &swap.lock);
+  freed = (swap.freed != freed);
+  release(&swap.lock);
+  return freed ? 0 : -1;
+}
+
+// Called on every clock tick: wake kswapd if free memory is
+// running low, so that it gets ahead of demand, and let it
+// try again if it had found nothing to swap out.
+void
+swaptick(void)
+{
+  acquire(&swap.lock);
+  if(swap.nslot > 0 && kfreecount() < SWAPLOW)
+    wakeup(&swap.wanted);
+  else
+    swap.stuck = 0;   //有进程退出释放了内存
+  release(&swap.lock);
+}
+
+// The page-out daemon.  Sleeps until free memory is low or a
+// process is waiting for a page, then swaps pages out until
+// there is enough again.
+void
+kswapd(void)
+{
+  struct superblock sb;
+  int wanted;
+
+  readsb(ROOTDEV, &sb);
+  acquire(&swap.lock);
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap / BPP;
+  if(swap.nslot > SWAPSIZE/BPP)
+    swap.nslot = SWAPSIZE/BPP;
+  release(&swap.lock);
+
+  for(;;){
+    acquire(&swap.lock);
+    // Once stuck, wait for the next tick before trying again.
+    if(swap.stuck || (!swap.wanted && kfreecount() >= SWAPLOW))
+      sleep(&swap.wanted, &swap.lock);
+    wanted = swap.wanted;
+    swap.wanted = 0;
+    release(&swap.lock);
+
+    while(wanted || kfreecount() < SWAPLOW){
+      if(swapout() < 0){   //换不出去了
+        acquire(&swap.lock);
+        swap.stuck = 1;
+        release(&swap.lock);
+        wakeup(&swap.freed);
+        break;
+      }
+      acquire(&swap.lock);
+      swap.freed++;
+      swap.stuck = 0;
+      release(&swap.lock);
+      wakeup(&swap.freed);
+      wanted = 0;
+    }
+  }
+}
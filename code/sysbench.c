@@ -0,0 +1,68 @@
+// System call benchmark.  Times a loop of getpid() calls made
+// through the stub in usys.S, which enters the kernel with
+// SYSENTER, and the same loop made with int $T_SYSCALL, the
+// way every system call went before.
+//
+// usage: sysbench [calls]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "date.h"
+#include "syscall.h"
+#include "traps.h"
+
+// getpid() the old way.
+static int
+intgetpid(void)
+{
+  int pid;
+
+  asm volatile("int %1" : "=a" (pid) : "i" (T_SYSCALL), "a" (SYS_getpid)
+               : "memory");
+  return pid;
+}
+
+// Microseconds from a to b.
+static int
+usecs(struct timespec *a, struct timespec *b)
+{
+  return (b->sec - a->sec) * 1000000 + ((int)b->nsec - (int)a->nsec) / 1000;
+}
+
+static void
+report(char *how, int n, int us)
+{
+  printf(1, "sysbench: %d getpid() with %s in %d us", n, how, us);
+  if(n >= 1000)
+    printf(1, ", %d ns per call", us / (n/1000));
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct timespec t0, t1;
+  int n, i;
+
+  n = 100000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    printf(2, "usage: sysbench [calls]\n");
+    exit();
+  }
+
+  clocktime(&t0);
+  for(i = 0; i < n; i++)
+    getpid();
+  clocktime(&t1);
+  report("sysenter", n, usecs(&t0, &t1));
+
+  clocktime(&t0);
+  for(i = 0; i < n; i++)
+    intgetpid();
+  clocktime(&t1);
+  report("int", n, usecs(&t0, &t1));
+  exit();
+}
@@ -17,9 +17,7 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(prefault(addr, 4, 0) < 0)   //检查地址合法，堆页可能还没分配，先把它缺页调进来
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -31,18 +29,15 @@ fetchint(uint addr, int *ip)
 int
 fetchstr(uint addr, char **pp)
 {
-  char *s, *ep;
-  struct proc *curproc = myproc();
+  char *s;
 
-  if(addr >= curproc->sz)
-    return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
+  for(s = *pp; ; s++){   //字符串可以在堆里也可以在mmap区域里，逐页检查
+    if((s == *pp || ((uint)s % PGSIZE) == 0) && prefault((uint)s, 1, 0) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
-  return -1;
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -53,17 +48,31 @@ argint(int n, int *ip)   //去参数整形数
 }
 
 // Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// to a block of memory of size bytes that the kernel will read.
+// Check that the pointer lies within the process address space.
 int
 argptr(int n, char **pp, int size)  //取参数指针
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
+  if(argint(n, &i) < 0)
+    return -1;
+  if(size < 0 || prefault(i, size, 0) < 0)
+    return -1;
+  *pp = (char*)i;
+  return 0;
+}
+
+// Like argptr, but for a block the kernel will write into,
+// so read-only mappings are refused as well.
+int
+argoutptr(int n, char **pp, int size)
+{
+  int i;
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || prefault(i, size, 1) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -71,8 +80,9 @@ argptr(int n, char **pp, int size)  //取参数指针
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (Another process sharing a MAP_SHARED page could change the
+// string after this check; the kernel only relies on it being
+// in valid user memory.)
 int
 argstr(int n, char **pp)    //取参数字符串
 {
@@ -103,6 +113,28 @@ extern int sys_unlink(void);
 extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_shmcreate(void);
+extern int sys_shmattach(void);
+extern int sys_shmdetach(void);
+extern int sys_nice(void);
+extern int sys_getpriority(void);
+extern int sys_clocktime(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex(void);
+extern int sys_getlockstat(void);
+extern int sys_ringsetup(void);
+extern int sys_ringenter(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_lseek(void);
+extern int sys_sendfile(void);
+extern int sys_nanosleep(void);
+extern int sys_mkpipe(void);
 
 static int (*syscalls[])(void) = {   //函数指针数组
 [SYS_fork]    sys_fork,     //SYS_fork 这个位置的函数指针是 sys_fork
@@ -126,8 +158,48 @@ static int (*syscalls[])(void) = {   //函数指针数组
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_shmcreate] sys_shmcreate,
+[SYS_shmattach] sys_shmattach,
+[SYS_shmdetach] sys_shmdetach,
+[SYS_nice]    sys_nice,
+[SYS_getpriority] sys_getpriority,
+[SYS_clocktime] sys_clocktime,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex]   sys_futex,
+[SYS_getlockstat] sys_getlockstat,
+[SYS_ringsetup] sys_ringsetup,
+[SYS_ringenter] sys_ringenter,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_lseek]   sys_lseek,
+[SYS_sendfile] sys_sendfile,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_mkpipe]  sys_mkpipe,
 };
 
+// Run system call num with its arguments at user address args
+// instead of on the user stack.  For the submission ring.
+int
+syscallat(int num, uint args)
+{
+  struct trapframe *tf = myproc()->tf;
+  uint esp;
+  int n, r;
+
+  esp = tf->esp;
+  n = myproc()->nfhold;
+  tf->esp = args - 4;   //argint()跳过的返回地址
+  r = syscalls[num]();
+  tf->esp = esp;
+  fdput(n);   //放下这个调用用fdget()拿的文件引用
+  return r;
+}
+
 void
 syscall(void)
 {
@@ -137,6 +209,7 @@ syscall(void)
   num = curproc->tf->eax;       //获取子功能号
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();      //调用相应的处理函数，返回值赋给eax
+    fdput(0);   //放下fdget()拿的文件引用
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
@@ -20,3 +20,25 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_mmap   22
+#define SYS_munmap 23
+#define SYS_shmcreate 24
+#define SYS_shmattach 25
+#define SYS_shmdetach 26
+#define SYS_nice   27
+#define SYS_getpriority 28
+#define SYS_clocktime 29
+#define SYS_clone  30
+#define SYS_join   31
+#define SYS_futex  32
+#define SYS_getlockstat 33
+#define SYS_ringsetup 34
+#define SYS_ringenter 35
+#define SYS_readv  36
+#define SYS_writev 37
+#define SYS_pread  38
+#define SYS_pwrite 39
+#define SYS_lseek  40
+#define SYS_sendfile 41
+#define SYS_nanosleep 42
+#define SYS_mkpipe 43
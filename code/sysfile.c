@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +27,7 @@ argfd(int n, int *pfd, struct file **pf)  //获取用户态下传给内核的参
 
   if(argint(n, &fd) < 0)    //取参数文件描述符
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -35,23 +36,6 @@ argfd(int n, int *pfd, struct file **pf)  //获取用户态下传给内核的参
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
-// Takes over file reference from caller on success.
-static int
-fdalloc(struct file *f)   //分配文件描述符
-{
-  int fd;
-  struct proc *curproc = myproc();   //当前进程控制块的地址
-
-  for(fd = 0; fd < NOFILE; fd++){  
-    if(curproc->ofile[fd] == 0){  //如果该描述符对应的元素为0则空闲可分配
-      curproc->ofile[fd] = f;  //填写文件结构体地址
-      return fd;   //返回文件描述符
-    }
-  }
-  return -1;
-}
-
 int
 sys_dup(void)   //系统调用dup，就是分配一个文件描述符使其指向文件结构体f，然后f的引用数加1
 {
@@ -73,7 +57,7 @@ sys_read(void)   //系统调用read
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)  //获取参数
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argoutptr(1, &p, n) < 0)  //获取参数
     return -1;
   return fileread(f, p, n);  //调用fileread读取
 }
@@ -90,15 +74,122 @@ sys_write(void)  //系统调用写
   return filewrite(f, p, n); //调用filewrite写
 }
 
+// Fetch the nth and n+1th system call arguments as an array of
+// struct iovec and its length, and copy it to iov, checking each
+// buffer as argptr() would, or as argoutptr() if out is set.
+static int
+argiov(int n, struct iovec *iov, int *pcnt, int out)
+{
+  struct iovec *uiov;
+  int i, cnt, tot;
+
+  if(argint(n+1, &cnt) < 0 || cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if(argptr(n, (void*)&uiov, cnt*sizeof(*uiov)) < 0)
+    return -1;
+  memmove(iov, uiov, cnt*sizeof(*uiov));   //拷进内核，免得检查之后被改
+  for(tot = i = 0; i < cnt; i++){
+    if((int)iov[i].len < 0 || (tot += iov[i].len) < 0)
+      return -1;
+    if(prefault((uint)iov[i].base, iov[i].len, out) < 0)
+      return -1;
+  }
+  *pcnt = cnt;
+  return 0;
+}
+
+// Read into several buffers with one call.
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt, 1) < 0)
+    return -1;
+  return filereadv(f, iov, cnt, -1);
+}
+
+// Write several buffers with one call.
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &cnt, 0) < 0)
+    return -1;
+  return filewritev(f, iov, cnt, -1);
+}
+
+// Read at a given offset, leaving the file offset alone.
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0 ||
+     off < 0 || argoutptr(1, &p, n) < 0)
+    return -1;
+  iov.base = p;
+  iov.len = n;
+  return filereadv(f, &iov, 1, off);
+}
+
+// Write at a given offset, leaving the file offset alone.
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argint(3, &off) < 0 ||
+     off < 0 || argptr(1, &p, n) < 0)
+    return -1;
+  iov.base = p;
+  iov.len = n;
+  return filewritev(f, &iov, 1, off);
+}
+
+// Move up to n bytes from one file to another inside the kernel.
+int
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int n;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesend(out, in, n);
+}
+
+// Move the file offset.
+int
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &whence) < 0)
+    return -1;
+  return fileseek(f, off, whence);
+}
+
 int
 sys_close(void)  //系统调用close
 {
   int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)  //获取参数
+  if(argint(0, &fd) < 0 || (f = fdfree(fd)) == 0)  //将打开文件描述符表的fd项清0
     return -1;
-  myproc()->ofile[fd] = 0;  //将打开文件描述符表的fd项清0
   fileclose(f);   //关闭相应的文件结构体
   return 0;
 }
@@ -109,7 +200,7 @@ sys_fstat(void)    //系统调用 fstat，获取一些inode信息
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0) //获取参数
+  if(argfd(0, 0, &f) < 0 || argoutptr(1, (void*)&st, sizeof(*st)) < 0) //获取参数
     return -1;
   return filestat(f, st);  //调用filestat实现
 }
@@ -419,21 +510,20 @@ sys_exec(void)
   return exec(path, argv);  //执行程序
 }
 
-int
-sys_pipe(void)   //创建管道
+// Make a pipe of npages pages and store descriptors for its
+// read and write ends in fd[0] and fd[1].
+static int
+mkpipe(int *fd, int npages)
 {
-  int *fd;
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
-    return -1;
-  if(pipealloc(&rf, &wf) < 0)  //分配管道(俩文件结构体和一片内存)
+  if(pipealloc(&rf, &wf, npages) < 0)  //分配管道(俩文件结构体和一片内存)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){  //分配俩文件描述符
     if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+      fdfree(fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -442,3 +532,29 @@ sys_pipe(void)   //创建管道
   fd[1] = fd1;
   return 0;
 }
+
+int
+sys_pipe(void)   //创建管道
+{
+  int *fd;
+
+  if(argoutptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+    return -1;
+  return mkpipe(fd, PIPEPAGES);
+}
+
+// A pipe that holds at least size bytes before a writer waits,
+// rounded up to a power of two pages.
+int
+sys_mkpipe(void)
+{
+  int *fd, size, n;
+
+  if(argoutptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0 || argint(1, &size) < 0)
+    return -1;
+  if(size <= 0 || size > PIPEMAXPAGES*PGSIZE)
+    return -1;
+  for(n = 1; n*PGSIZE < size; n *= 2)
+    ;
+  return mkpipe(fd, n);
+}
@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "fcntl.h"
+#include "lockstat.h"
 
 int
 sys_fork(void)
@@ -26,6 +28,36 @@ sys_wait(void)
   return wait();
 }
 
+int
+sys_clone(void)
+{
+  int fn, arg, stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+int
+sys_join(void)
+{
+  int tid;
+
+  if(argint(0, &tid) < 0)
+    return -1;
+  return join(tid);
+}
+
+int
+sys_futex(void)
+{
+  int addr, op, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  return futex(addr, op, val);
+}
+
 int
 sys_kill(void)
 {
@@ -42,6 +74,27 @@ sys_getpid(void)
   return myproc()->pid;
 }
 
+// Lower (or, down to 0, raise back) the caller's priority.
+int
+sys_nice(void)
+{
+  int inc;
+
+  if(argint(0, &inc) < 0)
+    return -1;
+  return nice(inc);
+}
+
+int
+sys_getpriority(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getpriority(pid);
+}
+
 int
 sys_sbrk(void)
 {
@@ -50,31 +103,42 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)  //获取参数:要分配的空间大小
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)  //调用growproc将进程的大小增加n字节
-    return -1;
-  return addr;   //返回增加的那部分空间的首地址
+  if(n >= 0){
+    mmlock(myproc()->pgdir);   //别的线程可能同时在sbrk
+    addr = myproc()->sz;
+    if(growproc(n) < 0)  //调用growproc将进程的大小增加n字节
+      addr = -1;
+    mmunlock(myproc()->pgdir);
+    return addr;   //返回增加的那部分空间的首地址
+  }
+
+  // Shrinking: wait for other threads' system calls that use
+  // the memory going away.  Another thread's sbrk() may move sz
+  // meanwhile; go round again if it did.
+  for(;;){
+    addr = myproc()->sz;
+    pinwait(addr + n, addr);
+    mmlock(myproc()->pgdir);
+    if(myproc()->sz == addr)
+      break;
+    mmunlock(myproc()->pgdir);
+    unpin();
+  }
+  if(growproc(n) < 0)
+    addr = -1;
+  mmunlock(myproc()->pgdir);
+  unpin();
+  return addr;
 }
 
 int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)   //取参数:要休眠的滴答数
     return -1;
-  acquire(&tickslock);  //取锁
-  ticks0 = ticks;      //记录当前滴答数
-  while(ticks - ticks0 < n){  //当过去的滴答数小于要休眠的滴答数
-    if(myproc()->killed){   //如果该进程被killed
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);  //休眠
-  }
-  release(&tickslock);  //解锁
-  return 0;   //返回
+  return ticksleep(n);   //挂到定时器轮上休眠
 }
 
 // return how many clock tick interrupts have occurred
@@ -82,10 +146,129 @@ sys_sleep(void)
 int
 sys_uptime(void)
 {
-  uint xticks;
+  return readticks();    //返回当前滴答数，不用取tickslock
+}
+
+// Store the time since boot, to the nanosecond.
+int
+sys_clocktime(void)
+{
+  struct timespec *ts;
+
+  if(argoutptr(0, (void*)&ts, sizeof(*ts)) < 0)   //nanotime()直接写用户内存，不能是只读页
+    return -1;
+  nanotime(ts);
+  return 0;
+}
+
+// Sleep for a time given to the nanosecond, which need not be
+// a whole number of ticks.
+int
+sys_nanosleep(void)
+{
+  struct timespec *ts;
+
+  if(argptr(0, (void*)&ts, sizeof(*ts)) < 0 || ts->nsec >= 1000000000)
+    return -1;
+  return timesleep(ts);
+}
+
+// Copy the lock statistics to an array of n struct lockstat,
+// clearing them afterwards if reset is set.
+int
+sys_getlockstat(void)
+{
+  char *buf;
+  int n, reset;
+
+  if(argint(1, &n) < 0 || argint(2, &reset) < 0 || n < 0)
+    return -1;
+  if(n > NLOCKCLASS)
+    n = NLOCKCLASS;
+  if(argoutptr(0, &buf, n*sizeof(struct lockstat)) < 0)
+    return -1;
+  return getlockstat((uint)buf, n, reset);
+}
+
+// Use the submission ring at the given address from now on.
+int
+sys_ringsetup(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return ringsetup(addr);
+}
+
+// Run up to n of the calls queued in the submission ring.
+int
+sys_ringenter(void)
+{
+  int n;
 
-  acquire(&tickslock);   //取滴答数的锁
-  xticks = ticks;      //当前滴答数
-  release(&tickslock);   //解锁
-  return xticks;    //返回当前滴答数
+  if(argint(0, &n) < 0)
+    return -1;
+  return ringenter(n);
+}
+
+int
+sys_mmap(void)
+{
+  int addr, len, prot, flags, fd, off;
+  struct file *f;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(4, &fd) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0)
+    return -1;
+  f = 0;
+  if(!(flags & MAP_ANONYMOUS) && (f = fdget(fd)) == 0)
+    return -1;
+  // The addr hint is ignored; the kernel picks the address.
+  return mmap(f, off, len, prot, flags);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  if(len <= 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+int
+sys_shmcreate(void)
+{
+  char *name;
+  int size;
+
+  if(argstr(0, &name) < 0 || argint(1, &size) < 0)
+    return -1;
+  return shmattach(name, size, 1);
+}
+
+int
+sys_shmattach(void)
+{
+  char *name;
+
+  if(argstr(0, &name) < 0)
+    return -1;
+  return shmattach(name, 0, 0);
+}
+
+int
+sys_shmdetach(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return shmdetach(addr);
 }
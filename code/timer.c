@@ -0,0 +1,335 @@
+// Timer wheel for processes sleeping until a given tick.
+//
+// A sleeper is kept on a list chosen by how far off its
+// deadline is: level 0 has a slot for each of the next 64
+// ticks, level 1 a slot for each of the next 64 stretches of
+// 64 ticks, and so on.  Each tick only looks at the level 0
+// slot for that tick, and every 64 ticks the next level 1 slot
+// is spread out over level 0 (and likewise between the higher
+// levels).  So a tick costs nothing for processes whose
+// deadline is still far off, instead of waking every sleeper
+// to recheck the time.
+//
+// The wheel is protected by tickslock, and so is ticks, which
+// readticks() reads without it under the tickseq sequence lock.
+//
+// Each CPU's LAPIC timer runs in one-shot mode and is armed
+// again for every tick by clockintr().  CPU 0 keeps ticks.  An
+// idle CPU stops its timer while halted, except that CPU 0, the
+// last to go idle, arms it for the next deadline on the wheel
+// instead, and counts the ticks it slept through on waking.
+//
+// timesleep() sleeps to a finer deadline than a tick: whole
+// ticks on the wheel, then the rest of the last tick by giving
+// up the CPU until the TSC says the deadline has passed.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "rwlock.h"
+#include "traps.h"
+#include "x86.h"
+#include "date.h"
+
+#define WHEELBITS  6
+#define WHEELSIZE  (1 << WHEELBITS)
+#define WHEELMASK  (WHEELSIZE-1)
+#define NLEVEL     4
+#define MAXDELTA   ((1 << (NLEVEL*WHEELBITS)) - 1)
+
+extern struct spinlock tickslock;
+extern uint ticks;
+
+static struct proc *wheel[NLEVEL][WHEELSIZE];
+static uint next = 1;   // Next tick for timertick() to look at
+
+// Put p on the slot for tick t.
+static void
+insert(struct proc *p, uint t)
+{
+  struct proc **slot;
+  uint delta;
+  int i;
+
+  if((int)(t - next) < 0)   //已经过期，下一个滴答就唤醒
+    t = next;
+  if(t - next > MAXDELTA)   //太远了先挂在最远处，到时再挂回去
+    t = next + MAXDELTA;
+  delta = t - next;
+  for(i = 0; i < NLEVEL-1; i++)
+    if(delta < (1 << ((i+1)*WHEELBITS)))
+      break;
+  slot = &wheel[i][(t >> (i*WHEELBITS)) & WHEELMASK];
+  p->tnext = *slot;
+  if(*slot)
+    (*slot)->tprev = &p->tnext;
+  p->tprev = slot;
+  *slot = p;
+}
+
+// Take p off its slot, if it is on one.
+void
+timerdel(struct proc *p)
+{
+  if(p->tprev == 0)
+    return;
+  *p->tprev = p->tnext;
+  if(p->tnext)
+    p->tnext->tprev = p->tprev;
+  p->tprev = 0;
+  p->tnext = 0;
+}
+
+// Wake p at tick t, unless it is woken before.
+// It sleeps on &p->wakeat.  Caller must hold tickslock.
+void
+timerset(struct proc *p, uint t)
+{
+  timerdel(p);
+  p->wakeat = t;
+  insert(p, t);
+  if(cpus[0].armed > 1)   //CPU 0在无滴答地睡，让它按新的期限重新定时
+    lapicipi(cpus[0].apicid, T_IRQ0 + IRQ_WAKE);
+}
+
+// Move the processes in slot i of a level > 0 down to
+// where they belong now.  Returns i.
+static int
+cascade(int level, int i)
+{
+  struct proc *p, *q;
+
+  p = wheel[level][i];
+  wheel[level][i] = 0;
+  for(; p; p = q){
+    q = p->tnext;
+    insert(p, p->wakeat);
+  }
+  return i;
+}
+
+// Wake the processes whose deadline is now, i.e. now or
+// earlier.  Called with tickslock held every time ticks
+// advances, by one or (with the timer off) more.
+void
+timertick(uint now)
+{
+  struct proc *p, *q;
+  int i;
+
+  while((int)(now - next) >= 0){
+    i = next & WHEELMASK;
+    if(i == 0 &&
+       cascade(1, (next >> WHEELBITS) & WHEELMASK) == 0 &&
+       cascade(2, (next >> 2*WHEELBITS) & WHEELMASK) == 0)
+      cascade(3, (next >> 3*WHEELBITS) & WHEELMASK);
+    p = wheel[0][i];
+    wheel[0][i] = 0;
+    next++;
+    for(; p; p = q){
+      q = p->tnext;
+      p->tprev = 0;
+      p->tnext = 0;
+      if((int)(p->wakeat - now) > 0)   //被截到MAXDELTA的远期定时，再挂回去
+        insert(p, p->wakeat);
+      else
+        wakeup(&p->wakeat);
+    }
+  }
+}
+
+// Ticks from now until timertick() has something to do: the
+// first deadline in level 0, or the next cascade if only the
+// higher levels hold any.  Returns ~0 if the wheel is empty.
+static uint
+timernext(void)
+{
+  int i, j;
+
+  for(i = 0; i < WHEELSIZE; i++)
+    if(wheel[0][(next + i) & WHEELMASK])
+      return i + 1;
+  for(i = 1; i < NLEVEL; i++)
+    for(j = 0; j < WHEELSIZE; j++)
+      if(wheel[i][j])
+        return ((WHEELSIZE - (next & WHEELMASK)) & WHEELMASK) + 1;
+  return ~0;
+}
+
+// CPU 0's clock has advanced by n ticks.
+static void
+advance(uint n)
+{
+  uint old;
+
+  acquire(&tickslock);
+  old = ticks;
+  seqwritebegin(&tickseq);
+  ticks += n;        //滴答数增加
+  seqwriteend(&tickseq);
+  timertick(ticks);  //只唤醒定时到期的进程
+  release(&tickslock);
+  if(ticks / BOOSTTICKS != old / BOOSTTICKS)   //定期提升所有进程的优先级
+    prioboost();
+  swaptick();
+}
+
+// Start this CPU's clock.
+void
+timerinit(void)
+{
+  mycpu()->armed = 1;
+  lapictimer(ticr);
+}
+
+// Timer interrupt: arm the timer for the next tick, on CPU 0
+// count the ticks it was armed for, and move RCU along.
+void
+clockintr(void)
+{
+  struct cpu *c = mycpu();
+  uint n;
+
+  n = c->armed;
+  c->armed = 1;
+  lapictimer(ticr);
+  if(c == &cpus[0] && n > 0)
+    advance(n);
+  rcutick();   //中断不会打断RCU读者，这里正是静止状态
+}
+
+// This CPU is about to halt with nothing to run: stop its
+// timer, or on CPU 0 arm it for the next deadline instead,
+// keeping the part of this tick that is left.
+// Called with interrupts disabled.
+void
+clockstop(void)
+{
+  struct cpu *c = mycpu();
+  uint n, left;
+
+  if(c != &cpus[0]){
+    c->armed = 0;
+    lapictimer(0);
+    return;
+  }
+  acquire(&tickslock);
+  n = timernext();
+  release(&tickslock);
+  if(rcupending())   //还有RCU回调等着宽限期过去，继续每个滴答都走时
+    n = 1;
+  if(n > 0xFFFFFFFF / ticr - 1)   //计数寄存器只有32位
+    n = 0xFFFFFFFF / ticr - 1;
+  if(n <= c->armed || (left = lapiccount()) == 0)
+    return;
+  c->armed = n;
+  lapictimer(left + (n-1)*ticr);
+}
+
+// This CPU has work, or may have: get its timer going for
+// every tick again, and on CPU 0 count the ticks it slept
+// through.  Called with interrupts disabled.
+void
+clockstart(void)
+{
+  struct cpu *c = mycpu();
+  uint left, n;
+
+  if(c->armed == 0){
+    c->armed = 1;
+    lapictimer(ticr);
+    return;
+  }
+  // If the timer has run out, clockintr() is pending and
+  // will count the ticks.
+  if(c->armed == 1 || (left = lapiccount()) == 0)
+    return;
+  n = c->armed - (left + ticr - 1) / ticr;   //已经过去的整滴答数
+  c->armed = 1;
+  lapictimer(left % ticr ? left % ticr : ticr);   //下一个滴答仍在原来的时刻
+  if(n > 0)
+    advance(n);
+}
+
+// The number of ticks since boot, read under tickseq instead
+// of tickslock so that readers on many CPUs do not contend.
+uint
+readticks(void)
+{
+  uint seq, t;
+
+  do{
+    seq = seqreadbegin(&tickseq);
+    t = ticks;
+  } while(seqreadretry(&tickseq, seq));   //读的时候滴答数变了，重读
+  return t;
+}
+
+// Sleep for n ticks.  Returns -1 if the process is killed
+// first, 0 otherwise.
+int
+ticksleep(int n)
+{
+  struct proc *p = myproc();
+  uint ticks0;
+
+  acquire(&tickslock);  //取锁
+  ticks0 = ticks;      //记录当前滴答数
+  while(ticks - ticks0 < n){  //当过去的滴答数小于要休眠的滴答数
+    if(p->killed){   //如果该进程被killed
+      timerdel(p);
+      release(&tickslock);
+      return -1;
+    }
+    timerset(p, ticks0 + n);   //到期时由timertick唤醒
+    sleep(&p->wakeat, &tickslock);  //休眠
+  }
+  timerdel(p);
+  release(&tickslock);  //解锁
+  return 0;
+}
+
+// Sleep for the time in *ts, to the nanosecond as nanotime()
+// keeps it.  All but the last part of a tick is slept on the
+// timer wheel; that last part, which a tick would overshoot,
+// is waited out in yield(), so other processes run meanwhile
+// but this CPU does not halt.  Returns -1 if the process is
+// killed first, 0 otherwise.
+int
+timesleep(struct timespec *ts)
+{
+  struct proc *p = myproc();
+  struct timespec now, end;
+  int left, n;
+
+  nanotime(&end);
+  end.sec += ts->sec + (end.nsec + ts->nsec) / 1000000000;
+  end.nsec = (end.nsec + ts->nsec) % 1000000000;
+  for(;;){
+    if(p->killed)
+      return -1;
+    nanotime(&now);
+    if((int)(end.sec - now.sec) < 0)
+      break;
+    if(end.sec - now.sec > 1){   //还远，先按整秒睡，免得下面的纳秒数溢出
+      n = end.sec - now.sec - 1;
+      if(n > 1000)
+        n = 1000;
+      if(ticksleep(n * HZ) < 0)
+        return -1;
+      continue;
+    }
+    left = (end.sec - now.sec) * 1000000000 + (int)(end.nsec - now.nsec);
+    if(left <= 0)
+      break;
+    if(left >= 1000000000 / HZ){   //至少还有一个整滴答
+      if(ticksleep(left / (1000000000 / HZ)) < 0)
+        return -1;
+    } else
+      yield();   //不到一个滴答，让出CPU，回来再看TSC
+  }
+  return 0;
+}
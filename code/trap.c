@@ -7,11 +7,15 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "rwlock.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
+extern char sysentry[];  // in trapasm.S: where SYSENTER goes
+int havesysenter;        // The CPUs have SYSENTER and SYSEXIT
 struct spinlock tickslock;
+struct seqlock tickseq;   // Lets readers of ticks do without tickslock
 uint ticks;
 
 void tvinit(void)   //根据外部的vectors数组构建中断门描述符
@@ -23,6 +27,7 @@ void tvinit(void)   //根据外部的vectors数组构建中断门描述符
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
 
   initlock(&tickslock, "time");
+  havesysenter = (cpufeatures() & CPUID_SEP) != 0;
 }
 
 
@@ -30,31 +35,66 @@ void
 idtinit(void)
 {
   lidt(idt, sizeof(idt));      //加载IDT地址到IDTR
+  if(havesysenter){   //SYSENTER的入口，内核栈由switchuvm设置
+    wrmsr(MSR_SYSENTER_CS, SEG_KCODE<<3);
+    wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+  }
+}
+
+// A system call, made with int $T_SYSCALL or with SYSENTER.
+// sysentry calls this directly, bypassing trap().
+void
+systrap(struct trapframe *tf)
+{
+  if(myproc()->killed)
+    exit();
+  myproc()->tf = tf;
+  myproc()->insyscall = 1;   //内核可能正直接访问用户内存，不能换出
+  syscall();     //系统调用处理程序
+  myproc()->insyscall = 0;
+  pinclear();    //等着解除映射的线程可以继续了
+  if(myproc()->killed)
+    exit();
+}
+
+// Is tf stopped at a SYSENTER in user space?  The stubs in usys.S
+// use it unconditionally, so a CPU without it gets here instead.
+static int
+atsysenter(struct trapframe *tf)
+{
+  int insn;
+
+  return (tf->cs&3) == DPL_USER && !havesysenter &&
+         fetchint(tf->eip, &insn) == 0 && (insn & 0xFFFF) == 0x340F;
 }
 
 //PAGEBREAK: 41
 void trap(struct trapframe *tf)
 {
   if(tf->trapno == T_SYSCALL){    //系统调用
-    if(myproc()->killed)
-      exit();
-    myproc()->tf = tf;
-    syscall();     //系统调用处理程序
-    if(myproc()->killed)
-      exit();
+    systrap(tf);
+    return;
+  }
+  if(tf->trapno == T_ILLOP && atsysenter(tf)){   //没有SYSENTER的CPU，照它的约定做系统调用
+    tf->eip = tf->edx;
+    tf->esp = tf->ecx;
+    systrap(tf);
     return;
   }
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:   //时钟中断
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;        //滴答数加1
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    clockintr();
     lapiceoi();  //写EOI表中断结束
     break;
+  case T_IRQ0 + IRQ_WAKE:   //别的CPU叫醒停机的本CPU，调度器会去找活干
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_TLB:   //别的CPU改了共享的页表
+    flushtlb();
+    mycpu()->tlbflush = 0;
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE:  //磁盘中断
     ideintr();    //磁盘中断处理程序
     lapiceoi();   //写EOI表中断结束
@@ -76,6 +116,15 @@ void trap(struct trapframe *tf)
             cpuid(), tf->cs, tf->eip);
     lapiceoi();
     break;
+  case T_PGFLT:   //缺页异常，懒分配的堆页在这里第一次分配
+    // In the kernel, only a system call touching user memory
+    // may fault on a missing user page; anything else is a
+    // kernel bug, and should panic rather than be papered over.
+    if(((tf->cs&3) == DPL_USER ||
+        (myproc() && myproc()->insyscall && rcr2() < KERNBASE)) &&
+       pagefault(rcr2(), tf->err) == 0)
+      break;
+    // Not a lazily allocated page: treat like any other bad trap.
 
   //PAGEBREAK: 13
   default:
@@ -99,10 +148,11 @@ void trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER) //如果被killed
      exit();  //退出
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU on clock tick once its time
+  // slice is over (see schedtick()).
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&  //发生了时钟中断
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     tf->trapno == T_IRQ0+IRQ_TIMER && schedtick())
      yield();  //主动让出CPU
 
   // Check if the process has been killed since we yielded
@@ -34,5 +34,7 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKE        20      // IPI to a halted CPU: there may be work
+#define IRQ_TLB         21      // IPI: flush the TLB (see tlbshootdown())
 #define IRQ_SPURIOUS    31
 
@@ -3,6 +3,7 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "ring.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -104,3 +105,221 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Spin locks for threads.  Zero-filled memory is an unlocked
+// lock, so static ones need no lock_init().
+void
+lock_init(struct lock *lk)
+{
+  lk->locked = 0;
+}
+
+void
+lock_acquire(struct lock *lk)
+{
+  while(xchg(&lk->locked, 1) != 0)
+    ;
+}
+
+void
+lock_release(struct lock *lk)
+{
+  xchg(&lk->locked, 0);
+}
+
+// Threads.  thread_create() runs fn(arg) in a new thread of this
+// process, and the thread exits when fn returns.  Stacks come
+// from sbrk() and are reused once thread_join() has seen their
+// thread finish.
+
+#define TSTACKSIZE 8192
+#define NTHREAD    64
+
+struct tstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static struct lock tlock;
+static struct {
+  int tid;
+  char *stack;
+  int busy;
+} threads[NTHREAD];
+
+static void
+tstart(void *a)
+{
+  struct tstart *t = a;
+
+  t->fn(t->arg);
+  exit();
+}
+
+// Returns the new thread's id, or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  struct tstart *t;
+  char *stack;
+  int i, tid;
+
+  lock_acquire(&tlock);
+  for(i = 0; i < NTHREAD; i++)
+    if(!threads[i].busy)
+      break;
+  if(i == NTHREAD){
+    lock_release(&tlock);
+    return -1;
+  }
+  if(threads[i].stack == 0){
+    stack = sbrk(TSTACKSIZE);
+    if(stack == (char*)-1){
+      lock_release(&tlock);
+      return -1;
+    }
+    threads[i].stack = stack;
+  }
+  stack = threads[i].stack;
+  t = (struct tstart*)(stack + TSTACKSIZE) - 1;   //放在新栈的顶上
+  t->fn = fn;
+  t->arg = arg;
+  if((tid = clone(tstart, t, t)) < 0){
+    lock_release(&tlock);
+    return -1;
+  }
+  threads[i].tid = tid;
+  threads[i].busy = 1;
+  lock_release(&tlock);
+  return tid;
+}
+
+// Wait for thread tid to finish.  Returns 0, or -1 if tid is
+// not a thread that the calling thread created.
+int
+thread_join(int tid)
+{
+  int i;
+
+  if(join(tid) < 0)
+    return -1;
+  lock_acquire(&tlock);
+  for(i = 0; i < NTHREAD; i++){
+    if(threads[i].busy && threads[i].tid == tid){
+      threads[i].busy = 0;   //栈留着给下一个线程用
+      break;
+    }
+  }
+  lock_release(&tlock);
+  return 0;
+}
+
+// Mutexes that sleep in futex() instead of spinning.  The state
+// is 0 when unlocked, 1 when locked and 2 when locked with
+// others perhaps asleep on it, so that neither locking a free
+// mutex nor unlocking one that nobody waits for enters the
+// kernel.  Zero-filled memory is an unlocked mutex.
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  uint c;
+
+  if((c = cmpxchg(&m->state, 0, 1)) == 0)   //没人持有，不用进内核
+    return;
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futex((int*)&m->state, FUTEX_WAIT, 2);
+    c = xchg(&m->state, 2);   //醒来时不知道还有没有别人在等，按有人等来算
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(xchg(&m->state, 0) == 2)   //可能有人睡着，叫醒一个
+    futex((int*)&m->state, FUTEX_WAKE, 1);
+}
+
+// Condition variables.  seq changes with every signal, so a
+// waiter that reads it before dropping the mutex does not sleep
+// through a signal that comes before it is asleep.
+void
+cond_init(struct cond *cv)
+{
+  cv->seq = 0;
+}
+
+void
+cond_wait(struct cond *cv, struct mutex *m)
+{
+  uint seq;
+
+  seq = cv->seq;
+  mutex_unlock(m);
+  futex((int*)&cv->seq, FUTEX_WAIT, seq);
+  while(xchg(&m->state, 2) != 0)   //别的等待者可能和我们一起被唤醒
+    futex((int*)&m->state, FUTEX_WAIT, 2);
+}
+
+static void
+condbump(struct cond *cv)
+{
+  uint seq;
+
+  do
+    seq = cv->seq;
+  while(cmpxchg(&cv->seq, seq, seq+1) != seq);
+}
+
+void
+cond_signal(struct cond *cv)
+{
+  condbump(cv);
+  futex((int*)&cv->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *cv)
+{
+  condbump(cv);
+  futex((int*)&cv->seq, FUTEX_WAKE, 0x7FFFFFFF);
+}
+
+// Queue system call op with arguments a0, a1, a2 in r, for the
+// next ringenter().  Returns -1 if the ring is full.
+int
+ring_queue(struct ring *r, int op, int flags, uint data, int a0, int a1, int a2)
+{
+  struct sqe *e;
+
+  if(r->sqtail - r->sqhead >= NRING)
+    return -1;
+  e = &r->sq[r->sqtail % NRING];
+  e->op = op;
+  e->flags = flags;
+  e->data = data;
+  e->arg[0] = a0;
+  e->arg[1] = a1;
+  e->arg[2] = a2;
+  r->sqtail++;   //填好了再让内核看到
+  return 0;
+}
+
+// Take the next completion from r into *c, without entering
+// the kernel.  Returns 0 if there is none yet.
+int
+ring_reap(struct ring *r, struct cqe *c)
+{
+  if(r->cqhead == r->cqtail)
+    return 0;
+  *c = r->cq[r->cqhead % NRING];
+  r->cqhead++;
+  return 1;
+}
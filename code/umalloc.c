@@ -20,9 +20,10 @@ typedef union header Header;
 
 static Header base;
 static Header *freep;
+static struct lock mlock;   // Threads share the heap
 
-void
-free(void *ap)
+static void
+freeblk(void *ap)
 {
   Header *bp, *p;
 
@@ -57,16 +58,25 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;   //申请的空间地址
   hp->s.size = nu;   //初始化空间大小
-  free((void*)(hp + 1));  //将申请到的空间加进原本的空闲链表
+  freeblk((void*)(hp + 1));  //将申请到的空间加进原本的空闲链表
   return freep;  //返回
 }
 
+void
+free(void *ap)
+{
+  lock_acquire(&mlock);
+  freeblk(ap);
+  lock_release(&mlock);
+}
+
 void*
 malloc(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
 
+  lock_acquire(&mlock);
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
   if((prevp = freep) == 0){    //freep若为0，表示第一次malloc，什么都还没有
     base.s.ptr = freep = prevp = &base;
@@ -82,10 +92,13 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;           //记录找到空闲块的位置
+      lock_release(&mlock);
       return (void*)(p + 1);   //将该块分配给用户空间，返回给用户的部分不包括头部，所以加1
     }
     if(p == freep)   //没有找到合适的块
-      if((p = morecore(nunits)) == 0)  //向内核申请nunits大小的空间
+      if((p = morecore(nunits)) == 0){  //向内核申请nunits大小的空间
+        lock_release(&mlock);
         return 0;
+      }
   }
 }
@@ -1,5 +1,9 @@
 struct stat;
 struct rtcdate;
+struct timespec;
+struct lockstat;
+struct ring;
+struct iovec;
 
 // system calls
 int fork(void);
@@ -23,6 +27,28 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+void* shmcreate(const char*, int);
+void* shmattach(const char*);
+int shmdetach(void*);
+int nice(int);
+int getpriority(int);
+int clocktime(struct timespec*);
+int clone(void(*)(void*), void*, void*);
+int join(int);
+int futex(int*, int, int);
+int getlockstat(struct lockstat*, int, int);
+int ringsetup(struct ring*);
+int ringenter(int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int lseek(int, int, int);
+int sendfile(int, int, int);
+int nanosleep(struct timespec*);
+int mkpipe(int*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -37,3 +63,31 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+
+// ulib.c: threads
+struct lock {
+  volatile uint locked;
+};
+void lock_init(struct lock*);
+void lock_acquire(struct lock*);
+void lock_release(struct lock*);
+int thread_create(void (*)(void*), void*);
+int thread_join(int);
+struct mutex {
+  volatile uint state;
+};
+struct cond {
+  volatile uint seq;
+};
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+
+// ulib.c: submission ring
+struct cqe;
+int ring_queue(struct ring*, int, int, uint, int, int, int);
+int ring_reap(struct ring*, struct cqe*);
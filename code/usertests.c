@@ -7,6 +7,11 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "elf.h"
+#include "date.h"
+#include "lockstat.h"
+#include "ring.h"
+#include "uio.h"
 
 char buf[8192];
 char name[3];
@@ -300,6 +305,60 @@ exectest(void)
   }
 }
 
+// exec() pages program segments in from the file on first
+// touch; does our own text, faulted in piece by piece, match
+// the bytes in the executable?
+void
+demandexec(void)
+{
+  struct elfhdr elf;
+  struct proghdr ph;
+  int fd, i, n;
+  uint off, a, end;
+
+  printf(stdout, "demand exec test\n");
+  fd = open("usertests", 0);
+  if(fd < 0){
+    printf(stdout, "open usertests failed\n");
+    exit();
+  }
+  if(read(fd, &elf, sizeof(elf)) != sizeof(elf) || elf.magic != ELF_MAGIC){
+    printf(stdout, "demand exec: bad elf header\n");
+    exit();
+  }
+  off = sizeof(elf);
+  for(; off < elf.phoff; off++)
+    read(fd, buf, 1);
+  if(read(fd, &ph, sizeof(ph)) != sizeof(ph) || ph.type != ELF_PROG_LOAD){
+    printf(stdout, "demand exec: bad program header\n");
+    exit();
+  }
+  off += sizeof(ph);
+  for(; off < ph.off; off++)
+    read(fd, buf, 1);
+
+  // Everything below this function is text, so nothing
+  // has written to it since exec.
+  end = (uint)demandexec;
+  for(a = ph.vaddr; a < end; a += n){
+    n = end - a;
+    if(n > sizeof(buf))
+      n = sizeof(buf);
+    if(read(fd, buf, n) != n){
+      printf(stdout, "demand exec: short read\n");
+      exit();
+    }
+    for(i = 0; i < n; i++){
+      if(buf[i] != ((char*)a)[i]){
+        printf(stdout, "demand exec: text differs at %x\n", a + i);
+        exit();
+      }
+    }
+  }
+  close(fd);
+  printf(stdout, "demand exec test ok\n");
+}
+
 // simple fork and pipe read/write
 
 void
@@ -354,6 +413,76 @@ pipe1(void)
   printf(1, "pipe1 ok\n");
 }
 
+// Fill the pipe fds and wrap around its ring many times, in
+// odd sizes that straddle the pages.
+void
+pipering(int *fds)
+{
+  int pid;
+  int seq, i, n, total;
+
+  pid = fork();
+  seq = 0;
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < 40; n++){
+      for(i = 0; i < 3001; i++)
+        buf[i] = seq++;
+      if(write(fds[1], buf, 3001) != 3001){
+        printf(1, "pipe2 oops 1\n");
+        exit();
+      }
+    }
+    exit();
+  } else if(pid > 0){
+    close(fds[1]);
+    sleep(2);   //让写者先把管道写满
+    total = 0;
+    while((n = read(fds[0], buf, 7919)) > 0){
+      for(i = 0; i < n; i++){
+        if((buf[i] & 0xff) != (seq++ & 0xff)){
+          printf(1, "pipe2 oops 2\n");
+          exit();
+        }
+      }
+      total += n;
+    }
+    if(total != 40 * 3001){
+      printf(1, "pipe2 oops 3 total %d\n", total);
+      exit();
+    }
+    close(fds[0]);
+    wait();
+  } else {
+    printf(1, "fork() failed\n");
+    exit();
+  }
+}
+
+// pipering() with the default ring, and with one of two pages
+// from mkpipe().
+void
+pipe2(void)
+{
+  int fds[2];
+
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  pipering(fds);
+  if(mkpipe(fds, 0) != -1 || mkpipe(fds, 100*4096) != -1){
+    printf(1, "mkpipe() took a bad size\n");
+    exit();
+  }
+  if(mkpipe(fds, 5000) != 0){
+    printf(1, "mkpipe() failed\n");
+    exit();
+  }
+  pipering(fds);
+  printf(1, "pipe2 ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -512,6 +641,75 @@ sharedfd(void)
   }
 }
 
+// four processes read one file, each through its own open file,
+// while another creates and removes files in the same directory,
+// to test inode locks shared by readers.
+void
+sharedread(void)
+{
+  int fd, pid, i, j, k;
+  char name[3];
+
+  printf(1, "sharedread test\n");
+
+  unlink("sharedread");
+  fd = open("sharedread", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "sharedread: cannot create\n");
+    exit();
+  }
+  for(i = 0; i < 8; i++){
+    memset(buf, 'a' + i, 512);
+    if(write(fd, buf, 512) != 512){
+      printf(1, "sharedread: write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+
+  for(k = 0; k < 5; k++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0 && k == 4){
+      name[0] = 's';
+      name[2] = 0;
+      for(i = 0; i < 20; i++){
+        name[1] = '0' + i % 10;
+        if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+          printf(1, "sharedread: create failed\n");
+          exit();
+        }
+        close(fd);
+        unlink(name);
+      }
+      exit();
+    }
+    if(pid == 0){
+      for(j = 0; j < 10; j++){
+        if((fd = open("sharedread", 0)) < 0){
+          printf(1, "sharedread: open failed\n");
+          exit();
+        }
+        for(i = 0; i < 8; i++){
+          if(read(fd, buf, 512) != 512 || buf[0] != 'a' + i || buf[511] != 'a' + i){
+            printf(1, "sharedread: block %d read wrong\n", i);
+            exit();
+          }
+        }
+        close(fd);
+      }
+      exit();
+    }
+  }
+  for(k = 0; k < 5; k++)
+    wait();
+  unlink("sharedread");
+  printf(1, "sharedread ok\n");
+}
+
 // four processes write different files at the same
 // time, to test block allocation.
 void
@@ -1546,6 +1744,943 @@ sbrktest(void)
   printf(stdout, "sbrk test OK\n");
 }
 
+// sbrk() only reserves address space; are the pages zeroed on
+// first touch, copied by fork, and usable as a read() buffer
+// before the process itself has touched them?
+void
+lazysbrk(void)
+{
+  char *a, *p;
+  int fd, pid;
+  uint amt;
+
+  printf(stdout, "lazy sbrk test\n");
+  amt = 64*1024*1024;
+  a = sbrk(amt);
+  if(a == (char*)0xffffffff){
+    printf(stdout, "lazy sbrk could not reserve %d bytes\n", amt);
+    exit();
+  }
+  for(p = a; p < a + amt; p += 1024*1024){
+    if(*p != 0){
+      printf(stdout, "lazy sbrk page not zeroed at %x\n", p);
+      exit();
+    }
+    *p = 'x';
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "lazy sbrk fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(p = a; p < a + amt; p += 1024*1024){
+      if(*p != 'x'){
+        printf(stdout, "lazy sbrk page lost across fork at %x\n", p);
+        exit();
+      }
+    }
+    exit();
+  }
+  wait();
+
+  // let the kernel be the first to touch a page
+  p = a + amt/2 + 5000;
+  fd = open("README", 0);
+  if(fd < 0){
+    printf(stdout, "lazy sbrk open README failed\n");
+    exit();
+  }
+  if(read(fd, p, 512) != 512){
+    printf(stdout, "lazy sbrk read into untouched page failed\n");
+    exit();
+  }
+  close(fd);
+
+  if(sbrk(-amt) == (char*)0xffffffff){
+    printf(stdout, "lazy sbrk could not deallocate\n");
+    exit();
+  }
+  printf(stdout, "lazy sbrk test OK\n");
+}
+
+// anonymous, shared file and private file mappings,
+// across fork and with partial unmaps.
+void
+mmaptest(void)
+{
+  char *a, *f, *r, *m[20];
+  int fd, fds[2], i, n, pid;
+
+  printf(stdout, "mmap test\n");
+
+  a = mmap(0, 3*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED){
+    printf(stdout, "mmap anonymous failed\n");
+    exit();
+  }
+  for(i = 0; i < 3*4096; i++){
+    if(a[i] != 0){
+      printf(stdout, "mmap anonymous page not zeroed\n");
+      exit();
+    }
+    a[i] = i;
+  }
+  if(munmap(a + 4096, 4096) < 0){
+    printf(stdout, "munmap middle page failed\n");
+    exit();
+  }
+  if(a[0] != 0 || a[2*4096+1] != (char)(2*4096+1)){
+    printf(stdout, "munmap middle page lost its neighbours\n");
+    exit();
+  }
+
+  munmap(a, 3*4096);
+
+  // splitting a region needs a free one; failing, munmap
+  // leaves every region as it was
+  a = mmap(0, 3*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED){
+    printf(stdout, "mmap anonymous failed\n");
+    exit();
+  }
+  a[4096] = 'M';
+  for(n = 0; n < 20; n++)
+    if((m[n] = mmap(0, 4096, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+      break;
+  if(n == 20 || munmap(a + 4096, 4096) != -1 ||
+     a[4096] != 'M' || a[2*4096] != 0){
+    printf(stdout, "failed munmap changed a region\n");
+    exit();
+  }
+  while(n > 0)
+    munmap(m[--n], 4096);
+  munmap(a, 3*4096);
+
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "mmap create file failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "mmap write file failed\n");
+    exit();
+  }
+  f = mmap(0, sizeof(buf), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  r = mmap(0, sizeof(buf), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(f == MAP_FAILED || r == MAP_FAILED){
+    printf(stdout, "mmap file failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++){
+    if(r[i] != buf[i]){
+      printf(stdout, "mmap file contents differ from write()\n");
+      exit();
+    }
+  }
+
+  // the kernel may read from a read-only mapping, but not store into it
+  if(pipe(fds) != 0 || write(fds[1], r, 10) != 10 || read(fds[0], buf, 10) != 10 ||
+     buf[9] != 'j'){
+    printf(stdout, "write() from read-only mapping failed\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  fd = open("mmapfile", O_RDWR);
+  if(read(fd, r, 10) != -1){
+    printf(stdout, "read() into read-only mapping succeeded\n");
+    exit();
+  }
+  close(fd);
+
+  f[0] = 'X';
+  f[5000] = 'Y';
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "mmap fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(f[0] != 'X'){
+      printf(stdout, "mmap shared page not inherited\n");
+      exit();
+    }
+    f[1] = 'Z';
+    exit();
+  }
+  wait();
+  if(f[1] != 'Z'){
+    printf(stdout, "mmap shared store by child not seen\n");
+    exit();
+  }
+  if(munmap(f, sizeof(buf)) < 0 || munmap(r, sizeof(buf)) < 0){
+    printf(stdout, "munmap file failed\n");
+    exit();
+  }
+
+  fd = open("mmapfile", O_RDWR);
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf) ||
+     buf[0] != 'X' || buf[1] != 'Z' || buf[5000] != 'Y' || buf[2] != 'c'){
+    printf(stdout, "mmap shared stores not written back\n");
+    exit();
+  }
+
+  f = mmap(0, sizeof(buf), PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(f == MAP_FAILED){
+    printf(stdout, "mmap private file failed\n");
+    exit();
+  }
+  f[0] = 'P';
+  munmap(f, sizeof(buf));
+  close(fd);
+  fd = open("mmapfile", 0);
+  if(read(fd, buf, 1) != 1 || buf[0] != 'X'){
+    printf(stdout, "mmap private store reached the file\n");
+    exit();
+  }
+  close(fd);
+
+  // processes that map the file on their own share its pages too
+  fd = open("mmapfile", O_RDWR);
+  f = mmap(0, sizeof(buf), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(f == MAP_FAILED){
+    printf(stdout, "mmap shared file failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "mmap fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    munmap(f, sizeof(buf));
+    close(fd);
+    fd = open("mmapfile", O_RDWR);
+    f = mmap(0, sizeof(buf), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if(f == MAP_FAILED){
+      printf(stdout, "mmap shared file in child failed\n");
+      exit();
+    }
+    f[6000] = 'C';
+    for(i = 0; i < 500 && ((volatile char*)f)[6001] != 'D'; i++)
+      sleep(1);
+    if(i == 500)
+      printf(stdout, "mmap store by parent not seen\n");
+    exit();
+  }
+  for(i = 0; i < 500 && ((volatile char*)f)[6000] != 'C'; i++)
+    sleep(1);
+  if(i == 500){
+    printf(stdout, "mmap store by separate mapping not seen\n");
+    exit();
+  }
+  if(pread(fd, buf, 1, 6000) != 1 || buf[0] != 'C'){
+    printf(stdout, "read() does not see mmap store\n");
+    exit();
+  }
+  if(pwrite(fd, "W", 1, 7000) != 1 || f[7000] != 'W'){
+    printf(stdout, "mmap does not see write()\n");
+    exit();
+  }
+  f[6001] = 'D';
+  wait();
+  munmap(f, sizeof(buf));
+  close(fd);
+  unlink("mmapfile");
+
+  printf(stdout, "mmap test ok\n");
+}
+
+// touch more pages than there is memory, so that kswapd has to
+// swap some out: do they all come back intact, through page
+// faults and as write() and read() buffers?
+void
+swaptest(void)
+{
+  enum { NPAGE = PHYSTOP/4096 };   // as many pages as the machine has
+  int fds[2], i, n;
+  char *a, *p;
+
+  printf(stdout, "swap test\n");
+  // private anonymous memory, so no superpages, which stay put
+  a = mmap(0, NPAGE*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED){
+    printf(stdout, "swap mmap failed\n");
+    exit();
+  }
+  for(i = 0; i < NPAGE; i++){
+    p = a + i*4096;
+    *(int*)p = i;
+    p[4095] = i;
+  }
+  for(i = 0; i < NPAGE; i++){
+    p = a + i*4096;
+    if(*(int*)p != i || p[4095] != (char)i){
+      printf(stdout, "swap page %d came back wrong\n", i);
+      exit();
+    }
+  }
+
+  // the oldest pages are the likeliest to be out again by now
+  if(pipe(fds) != 0){
+    printf(stdout, "swap pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < 64; i += 2){
+    if(write(fds[1], a + i*4096, 4096) != 4096 ||
+       read(fds[0], a + (i+1)*4096, 4096) != 4096){
+      printf(stdout, "swap write/read failed\n");
+      exit();
+    }
+    n = *(int*)(a + (i+1)*4096);
+    if(n != i){
+      printf(stdout, "swap read %d into page %d, want %d\n", n, i+1, i);
+      exit();
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  munmap(a, NPAGE*4096);
+  printf(stdout, "swap test ok\n");
+}
+
+// named shared memory segments: attach by name, survive
+// fork, and go away with the last detach.
+void
+shmtest(void)
+{
+  char *a, *b;
+  int i, pid, fds[2];
+
+  printf(stdout, "shm test\n");
+  a = shmcreate("shmtest", 3*4096);
+  if(a == (char*)-1){
+    printf(stdout, "shmcreate failed\n");
+    exit();
+  }
+  if(shmcreate("shmtest", 4096) != (char*)-1){
+    printf(stdout, "shmcreate of existing segment succeeded\n");
+    exit();
+  }
+  if(pipe(fds) != 0){
+    printf(stdout, "shm pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "shm fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    // producer: fill the segment through a second mapping of it
+    b = shmattach("shmtest");
+    if(b == (char*)-1 || b == a){
+      printf(stdout, "shmattach failed\n");
+      exit();
+    }
+    for(i = 0; i < 3*4096; i++)
+      b[i] = i % 251;
+    if(a[4097] != b[4097]){
+      printf(stdout, "shm inherited mapping differs\n");
+      exit();
+    }
+    shmdetach(b);
+    write(fds[1], "x", 1);
+    exit();
+  }
+  // consumer
+  if(read(fds[0], buf, 1) != 1){
+    printf(stdout, "shm pipe read failed\n");
+    exit();
+  }
+  for(i = 0; i < 3*4096; i++){
+    if(a[i] != (char)(i % 251)){
+      printf(stdout, "shm data not shared at %d\n", i);
+      exit();
+    }
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  if(shmdetach(a) != 0){
+    printf(stdout, "shmdetach failed\n");
+    exit();
+  }
+  if(shmattach("shmtest") != (char*)-1){
+    printf(stdout, "shm segment outlived its last detach\n");
+    exit();
+  }
+  printf(stdout, "shm test ok\n");
+}
+
+// nice() clamps and reports the nice value; getpriority()
+// finds live processes only.
+void
+nicetest(void)
+{
+  int pid, fds[2];
+  char c;
+
+  printf(stdout, "nice test\n");
+  if(pipe(fds) != 0){
+    printf(stdout, "nice pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "nice fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(nice(5) != 5 || nice(100) != 19 || nice(-100) != 0){
+      printf(stdout, "nice gave wrong value\n");
+      exit();
+    }
+    nice(19);
+    if(getpriority(0) <= 0){
+      printf(stdout, "nice 19 at top level\n");
+      exit();
+    }
+    read(fds[0], &c, 1);
+    exit();
+  }
+  if(getpriority(pid) < 0){
+    printf(stdout, "getpriority of child failed\n");
+    exit();
+  }
+  write(fds[1], "x", 1);
+  wait();
+  if(getpriority(pid) != -1){
+    printf(stdout, "getpriority of dead child succeeded\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  printf(stdout, "nice test ok\n");
+}
+
+// sleep() on the timer wheel: short sleeps, and one long
+// enough to be moved down from the second level.
+void
+sleeptest(void)
+{
+  static int n[] = { 1, 3, 70 };
+  int i, t0, t;
+
+  printf(stdout, "sleep test\n");
+  for(i = 0; i < sizeof(n)/sizeof(n[0]); i++){
+    t0 = uptime();
+    if(sleep(n[i]) != 0){
+      printf(stdout, "sleep failed\n");
+      exit();
+    }
+    t = uptime() - t0;
+    if(t < n[i] || t > n[i] + 20){
+      printf(stdout, "sleep(%d) took %d ticks\n", n[i], t);
+      exit();
+    }
+  }
+  printf(stdout, "sleep test ok\n");
+}
+
+// clocktime() never goes backwards, and agrees with the
+// tick count about how long a sleep took.
+void
+clocktest(void)
+{
+  struct timespec a, b;
+  int i, ms, us;
+
+  printf(stdout, "clock test\n");
+  clocktime(&a);
+  for(i = 0; i < 1000; i++){
+    clocktime(&b);
+    if(b.nsec >= 1000000000 || b.sec < a.sec ||
+       (b.sec == a.sec && b.nsec < a.nsec)){
+      printf(stdout, "clocktime went from %d.%d to %d.%d\n",
+             a.sec, a.nsec, b.sec, b.nsec);
+      exit();
+    }
+    a = b;
+  }
+  sleep(HZ/10);
+  clocktime(&b);
+  ms = (b.sec - a.sec) * 1000 + (int)(b.nsec - a.nsec) / 1000000;
+  if(ms < 100 - 1000/HZ || ms > 10000){
+    printf(stdout, "sleep of 100ms took %dms\n", ms);
+    exit();
+  }
+
+  // nanosleep() is not rounded to ticks
+  a.sec = 0;
+  a.nsec = 2500000;
+  clocktime(&b);
+  if(nanosleep(&a) != 0){
+    printf(stdout, "nanosleep failed\n");
+    exit();
+  }
+  clocktime(&a);
+  us = (a.sec - b.sec) * 1000000 + (int)(a.nsec - b.nsec) / 1000;
+  if(us < 2500 || us > 10000000){
+    printf(stdout, "nanosleep of 2500us took %dus\n", us);
+    exit();
+  }
+  a.nsec = 1000000000;
+  if(nanosleep(&a) != -1){
+    printf(stdout, "nanosleep took a bad time\n");
+    exit();
+  }
+  printf(stdout, "clock test ok\n");
+}
+
+// Threads share memory, including memory that one of them
+// adds with sbrk() after the others have started, and open
+// files.
+struct lock tlk;
+int tcount, tfd;
+char *theap;
+
+void
+threadwork(void *arg)
+{
+  int i;
+
+  if((int)arg == 0){
+    theap = sbrk(4096);
+    theap[4095] = 'x';
+    tfd = open("README", 0);   //其他线程也能用这个描述符
+  }
+  for(i = 0; i < 1000; i++){
+    lock_acquire(&tlk);
+    tcount++;
+    lock_release(&tlk);
+  }
+}
+
+void
+threadtest(void)
+{
+  int i, tid[4];
+
+  printf(stdout, "thread test\n");
+  for(i = 0; i < 4; i++){
+    if((tid[i] = thread_create(threadwork, (void*)i)) < 0){
+      printf(stdout, "thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++){
+    if(thread_join(tid[i]) != 0){
+      printf(stdout, "thread_join failed\n");
+      exit();
+    }
+  }
+  if(tcount != 4000){
+    printf(stdout, "threads counted %d, not 4000\n", tcount);
+    exit();
+  }
+  if(theap == 0 || theap[4095] != 'x'){
+    printf(stdout, "memory grown by a thread is not shared\n");
+    exit();
+  }
+  if(join(tid[0]) != -1 || wait() != -1){
+    printf(stdout, "joined thread still there\n");
+    exit();
+  }
+  if(tfd < 0 || read(tfd, buf, 1) != 1 || close(tfd) != 0){
+    printf(stdout, "file opened by a thread is not shared\n");
+    exit();
+  }
+  printf(stdout, "thread test ok\n");
+}
+
+// munmap() while another thread is in read() into the region:
+// the read must finish first or fail, not fault in the kernel
+// on memory that is gone.
+char *umem;
+volatile int ureads, udone;
+
+void
+unmapwork(void *arg)
+{
+  int fd;
+
+  fd = open("README", 0);
+  while(pread(fd, umem + 4096 - 100, 4096, 0) > 0)   //跨两页
+    ureads++;
+  close(fd);
+  udone = 1;
+}
+
+void
+unmaprace(void)
+{
+  int i, tid;
+
+  printf(stdout, "unmap race test\n");
+  for(i = 0; i < 20; i++){
+    umem = mmap(0, 2*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(umem == MAP_FAILED){
+      printf(stdout, "unmap race mmap failed\n");
+      exit();
+    }
+    ureads = udone = 0;
+    if((tid = thread_create(unmapwork, 0)) < 0){
+      printf(stdout, "unmap race thread_create failed\n");
+      exit();
+    }
+    while(ureads < i && !udone)   //让它先读几次，多碰几种时机
+      ;
+    if(munmap(umem, 2*4096) < 0){
+      printf(stdout, "unmap race munmap failed\n");
+      exit();
+    }
+    if(thread_join(tid) != 0){
+      printf(stdout, "unmap race thread_join failed\n");
+      exit();
+    }
+  }
+  printf(stdout, "unmap race test ok\n");
+}
+
+// Futexes: a mutex and a condition variable shared by threads,
+// and a wakeup across processes that map the same word at
+// different addresses.
+struct mutex fmu;
+struct cond fcv;
+int fcount, fitems;
+
+void
+futexwork(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++){
+    mutex_lock(&fmu);
+    fcount++;
+    if(i % 10 == 0){
+      fitems++;
+      cond_signal(&fcv);
+    }
+    mutex_unlock(&fmu);
+  }
+}
+
+void
+futextest(void)
+{
+  int i, n, tid[4], pid;
+  int *w;
+
+  printf(stdout, "futex test\n");
+  n = 5;
+  if(futex(&n, FUTEX_WAIT, 6) != -1){
+    printf(stdout, "futex wait on changed word slept\n");
+    exit();
+  }
+  for(i = 0; i < 4; i++){
+    if((tid[i] = thread_create(futexwork, 0)) < 0){
+      printf(stdout, "thread_create failed\n");
+      exit();
+    }
+  }
+  // Consume every item as the threads produce it.
+  mutex_lock(&fmu);
+  for(n = 0; n < 4*100; n++){
+    while(fitems == 0)
+      cond_wait(&fcv, &fmu);
+    fitems--;
+  }
+  mutex_unlock(&fmu);
+  for(i = 0; i < 4; i++)
+    thread_join(tid[i]);
+  if(fcount != 4000 || fitems != 0){
+    printf(stdout, "futex mutex counted %d, %d items left\n", fcount, fitems);
+    exit();
+  }
+
+  w = (int*)shmcreate("futextest", 4096);
+  if(w == (int*)-1){
+    printf(stdout, "futex shmcreate failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "futex fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    w = (int*)shmattach("futextest");   //另一个地址，同一个物理页
+    sleep(2);
+    *w = 1;
+    futex(w, FUTEX_WAKE, 1);
+    exit();
+  }
+  while(*w == 0)
+    futex(w, FUTEX_WAIT, 0);
+  wait();
+  shmdetach(w);
+  printf(stdout, "futex test ok\n");
+}
+
+// Lock statistics count acquisitions, and start over on reset.
+struct lockstat lstats[NLOCKCLASS];
+
+void
+lockstattest(void)
+{
+  int i, n, fd;
+
+  printf(stdout, "lockstat test\n");
+  n = getlockstat(lstats, NLOCKCLASS, 1);
+  for(i = 0; i < n; i++)
+    if(strcmp(lstats[i].name, "ftable") == 0 && !lstats[i].sleep)
+      break;
+  if(n <= 0 || i == n || lstats[i].nacquire == 0){
+    printf(stdout, "no ftable lock statistics\n");
+    exit();
+  }
+  for(n = 0; n < 10; n++){
+    fd = dup(1);
+    close(fd);
+  }
+  n = getlockstat(lstats, NLOCKCLASS, 0);
+  if(n <= i || lstats[i].nacquire < 20 || lstats[i].nacquire > 1000){
+    printf(stdout, "ftable lock taken %d times after reset\n", lstats[i].nacquire);
+    exit();
+  }
+  printf(stdout, "lockstat test ok\n");
+}
+
+struct ring ring;
+
+// Run the n calls queued in ring and reap their results into res.
+void
+ringrun(int n, int *res)
+{
+  struct cqe c;
+  int i;
+
+  if(ringenter(n) != n){
+    printf(stdout, "ringenter failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    if(ring_reap(&ring, &c) == 0 || c.data != i){
+      printf(stdout, "ring completion %d missing\n", i);
+      exit();
+    }
+    res[i] = c.res;
+  }
+  if(ring_reap(&ring, &c)){
+    printf(stdout, "ring has extra completions\n");
+    exit();
+  }
+}
+
+void
+ringtest(void)
+{
+  int res[4], fd;
+
+  printf(stdout, "ring test\n");
+  if(ringenter(1) != -1 || ringsetup(&ring) < 0){
+    printf(stdout, "ringsetup failed\n");
+    exit();
+  }
+
+  ring_queue(&ring, SYS_open, RING_LINK, 0, (int)"ringfile", O_CREATE|O_RDWR, 0);
+  ring_queue(&ring, SYS_write, RING_FDPREV, 1, 0, (int)"ring data", 9);
+  ringrun(2, res);
+  if((fd = res[0]) < 0 || res[1] != 9){
+    printf(stdout, "ring open/write gave %d %d\n", res[0], res[1]);
+    exit();
+  }
+
+  memset(buf, 0, sizeof(buf));
+  ring_queue(&ring, SYS_close, 0, 0, fd, 0, 0);
+  ring_queue(&ring, SYS_open, RING_LINK, 1, (int)"ringfile", O_RDONLY, 0);
+  ring_queue(&ring, SYS_read, RING_FDPREV, 2, 0, (int)buf, sizeof(buf));
+  ringrun(3, res);
+  if(res[0] != 0 || (fd = res[1]) < 0 || res[2] != 9 || strcmp(buf, "ring data") != 0){
+    printf(stdout, "ring close/open/read gave %d %d %d\n", res[0], res[1], res[2]);
+    exit();
+  }
+  close(fd);
+
+  // A failed call cancels the rest of its chain, but not the
+  // next chain; calls a ring may not carry fail.
+  ring_queue(&ring, SYS_open, RING_LINK, 0, (int)"nosuchfile", O_RDONLY, 0);
+  ring_queue(&ring, SYS_close, RING_LINK, 1, 0, 0, 0);
+  ring_queue(&ring, SYS_write, 0, 2, 1, (int)"", 0);
+  ring_queue(&ring, SYS_fork, 0, 3, 0, 0, 0);
+  ringrun(4, res);
+  if(res[0] != -1 || res[1] != -1 || res[2] != 0 || res[3] != -1){
+    printf(stdout, "ring chain gave %d %d %d %d\n", res[0], res[1], res[2], res[3]);
+    exit();
+  }
+  if(fstat(0, (struct stat*)buf) < 0){   //被取消的close不能真的关掉0
+    printf(stdout, "cancelled ring close ran\n");
+    exit();
+  }
+
+  ringsetup(0);
+  unlink("ringfile");
+  printf(stdout, "ring test ok\n");
+}
+
+// readv, writev, pread, pwrite and lseek.
+void
+iovtest(void)
+{
+  struct iovec iov[3];
+  char a[5], b[8];
+  int fd, n;
+
+  printf(stdout, "iov test\n");
+  fd = open("iovfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "open iovfile failed\n");
+    exit();
+  }
+  iov[0].base = "abc";
+  iov[0].len = 3;
+  iov[1].base = "";
+  iov[1].len = 0;
+  iov[2].base = "defghij";
+  iov[2].len = 7;
+  if(writev(fd, iov, 3) != 10 || lseek(fd, 0, SEEK_CUR) != 10){
+    printf(stdout, "writev failed\n");
+    exit();
+  }
+  if(pwrite(fd, "XY", 2, 3) != 2 || lseek(fd, 0, SEEK_CUR) != 10){
+    printf(stdout, "pwrite failed\n");
+    exit();
+  }
+  memset(buf, 0, sizeof(buf));
+  if(pread(fd, buf, sizeof(buf), 2) != 8 || strcmp(buf, "cXYfghij") != 0){
+    printf(stdout, "pread failed\n");
+    exit();
+  }
+  if(lseek(fd, 11, SEEK_SET) != -1 || lseek(fd, -4, SEEK_END) != 6 ||
+     lseek(fd, -6, SEEK_CUR) != 0){
+    printf(stdout, "lseek failed\n");
+    exit();
+  }
+  iov[0].base = a;
+  iov[0].len = 4;
+  iov[1].base = b;
+  iov[1].len = 8;
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  if((n = readv(fd, iov, 2)) != 10 || strcmp(a, "abcX") != 0 ||
+     strcmp(b, "Yfghij") != 0 || read(fd, buf, 1) != 0){
+    printf(stdout, "readv read %d\n", n);
+    exit();
+  }
+  iov[0].base = (void*)0x7FFFFFF0;   //不在进程的内存里
+  if(readv(fd, iov, 1) != -1 || writev(fd, iov, IOV_MAX+1) != -1){
+    printf(stdout, "readv took bad buffers\n");
+    exit();
+  }
+  close(fd);
+  unlink("iovfile");
+  printf(stdout, "iov test ok\n");
+}
+
+// sendfile() from a file into a pipe and into another file.
+// The file is bigger than the pipe, so the sender has to wait.
+void
+sendfiletest(void)
+{
+  enum { SENDSIZE = 20000 };   // more than PIPEPAGES*4096
+  int fd, fd2, fds[2], i, n, tot, pid;
+
+  printf(stdout, "sendfile test\n");
+  fd = open("sendfile0", O_CREATE|O_RDWR);
+  for(tot = 0; tot < SENDSIZE; tot += 1000){
+    for(i = 0; i < 1000; i++)
+      buf[i] = 'a' + (tot + i) % 23;
+    if(fd < 0 || write(fd, buf, 1000) != 1000){
+      printf(stdout, "sendfile0 write failed\n");
+      exit();
+    }
+  }
+  if(lseek(fd, 0, SEEK_SET) != 0){
+    printf(stdout, "sendfile0 lseek failed\n");
+    exit();
+  }
+  if(pipe(fds) < 0){
+    printf(stdout, "pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[1]);
+    tot = 0;
+    while((n = read(fds[0], buf + 4000, 1000)) > 0){
+      for(i = 0; i < n; i++, tot++){
+        if(buf[4000+i] != 'a' + tot % 23){
+          printf(stdout, "sendfile pipe data wrong at %d\n", tot);
+          exit();
+        }
+      }
+      sleep(1);
+    }
+    if(tot != SENDSIZE){
+      printf(stdout, "sendfile pipe got %d bytes\n", tot);
+      exit();
+    }
+    exit();
+  }
+  close(fds[0]);
+  if((n = sendfile(fds[1], fd, 2*SENDSIZE)) != SENDSIZE || sendfile(fds[1], fd, 10) != 0){
+    printf(stdout, "sendfile to pipe moved %d\n", n);
+    exit();
+  }
+  close(fds[1]);
+  wait();
+
+  fd2 = open("sendfile1", O_CREATE|O_RDWR);
+  if(fd2 < 0 || lseek(fd, 1000, SEEK_SET) != 1000 ||
+     (n = sendfile(fd2, fd, 2*SENDSIZE)) != SENDSIZE - 1000){
+    printf(stdout, "sendfile to file moved %d\n", n);
+    exit();
+  }
+  for(tot = 0; tot < SENDSIZE - 1000; tot += n){
+    if((n = pread(fd2, buf, 1000, tot)) <= 0){
+      printf(stdout, "sendfile1 read failed\n");
+      exit();
+    }
+    for(i = 0; i < n; i++){
+      if(buf[i] != 'a' + (1000 + tot + i) % 23){
+        printf(stdout, "sendfile file data wrong at %d\n", tot + i);
+        exit();
+      }
+    }
+  }
+  if(pipe(fds) < 0 || sendfile(fd2, fds[0], 1) != -1 || sendfile(fds[0], fd, 1) != -1){
+    printf(stdout, "sendfile took a bad file\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(fd);
+  close(fd2);
+  unlink("sendfile0");
+  unlink("sendfile1");
+  printf(stdout, "sendfile test ok\n");
+}
+
 void
 validateint(int *p)
 {
@@ -1762,12 +2897,27 @@ main(int argc, char *argv[])
   concreate();
   fourfiles();
   sharedfd();
+  sharedread();
 
   bigargtest();
   bigwrite();
   bigargtest();
   bsstest();
   sbrktest();
+  lazysbrk();
+  mmaptest();
+  swaptest();
+  shmtest();
+  nicetest();
+  sleeptest();
+  clocktest();
+  threadtest();
+  unmaprace();
+  futextest();
+  lockstattest();
+  ringtest();
+  iovtest();
+  sendfiletest();
   validatetest();
 
   opentest();
@@ -1781,6 +2931,7 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  pipe2();
   preempt();
   exitwait();
 
@@ -1796,6 +2947,7 @@ main(int argc, char *argv[])
   bigdir(); // slow
 
   uio();
+  demandexec();
 
   exectest();
 
@@ -6,10 +6,19 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "stat.h"
+#include "traps.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
+static void putvm(pde_t*);
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
@@ -32,7 +41,9 @@ seginit(void)    //设置内核用户的代码段和数据段
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
+// create any required page table pages.  If va is mapped by
+// a 4MB superpage, the directory entry itself is returned:
+// callers must check PTE_PS before taking PTE_ADDR as the page.
 static pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
@@ -40,6 +51,8 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];   //va取高12位->页目录项
+  if(*pde & PTE_PS)        //4M大页，没有二级页表
+    return pde;
   if(*pde & PTE_P){        //若一级页表存在
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));   //取一级页表的物理地址，转化成虚拟地址
   } else {
@@ -114,40 +127,125 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Map a kmap[] range into pgdir.  Every 4MB-aligned stretch
+// is mapped by a single PTE_PS directory entry, which needs no
+// page table page and takes one TLB entry; only the ends of the
+// range use 4KB pages.  All kernel mappings are global (PTE_G),
+// since they are the same in every page table.
+static int
+mapkvm(pde_t *pgdir, char *va, uint size, uint pa, int perm)
+{
+  char *last;
+
+  last = va + size;   //DEVSPACE一项会回绕到0
+  while(va != last){
+    if((uint)va % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 &&
+       (uint)(last - va) >= SUPERPGSIZE){
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS | PTE_G;  //一个目录项映射4M
+      va += SUPERPGSIZE;
+      pa += SUPERPGSIZE;
+      continue;
+    }
+    if(mappages(pgdir, va, PGSIZE, pa, perm | PTE_G) < 0)
+      return -1;
+    va += PGSIZE;
+    pa += PGSIZE;
+  }
+  return 0;
+}
+
+// Set up kernel part of a page table.  The kernel half of
+// every page directory is a copy of kpgdir's: the directory
+// entries point at the same superpages and the same page
+// table pages, built once by kvmalloc() and never freed.
 pde_t* setupkvm(void)      //建立内核页表
 {
   pde_t *pgdir;
-  struct kmap *k;
 
   if((pgdir = (pde_t*)kalloc()) == 0)    //分配一页作为页目录表
     return 0; 
-  memset(pgdir, 0, PGSIZE);              //页目录表置0
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)    //PHYSTOP的地址不能高于DEVSPACE
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)    //映射4项，循环4次
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start, (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
-    }
+  memset(pgdir, 0, PDX(KERNBASE)*sizeof(pde_t));   //用户部分置0
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],   //内核部分共享kpgdir的页表
+          (NPDENTRIES-PDX(KERNBASE))*sizeof(pde_t));
   return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes.  Its kernel half is the one
+// shared by all the others.
 void kvmalloc(void)
 {
-  kpgdir = setupkvm();  //建立页表
+  struct kmap *k;
+
+  if((kpgdir = (pde_t*)kalloc()) == 0)
+    panic("kvmalloc");
+  memset(kpgdir, 0, PGSIZE);              //页目录表置0
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)    //PHYSTOP的地址不能高于DEVSPACE
+    panic("PHYSTOP too high");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)    //映射4项，循环4次
+    if(mapkvm(kpgdir, k->virt, k->phys_end - k->phys_start, (uint)k->phys_start, k->perm) < 0)
+      panic("kvmalloc: out of memory");
   switchkvm();    //切换页表
 }
 
+// Load pgdir into %cr3 on this CPU, unless it is there already
+// and force is not set: reloading %cr3 flushes every non-global
+// TLB entry.  The scheduler no longer switches to kpgdir after
+// each process, so any number of CPUs may still be on the page
+// table of a process that has since exited or exec'd.  Each CPU
+// therefore holds a reference to the page directory it is on,
+// and whichever of freevm() and the CPUs drops the last one
+// frees the page table.
+// Caller must have interrupts disabled.
+static void
+loadpgdir(pde_t *pgdir, int force)
+{
+  struct cpu *c = mycpu();
+  pde_t *old;
+
+  if(c->pgdir == pgdir && !force)   //同一个地址空间，不用刷TLB
+    return;
+  if(pgdir != kpgdir)
+    kdup((char*)pgdir);   //本CPU用着这个页目录
+  lcr3(V2P(pgdir));   //加载页表到cr3寄存器，cr3存放的是页目录物理地址
+  old = c->pgdir;
+  c->pgdir = pgdir;
+  if(old && old != kpgdir)
+    putvm(old);   //离开旧页目录，最后一个离开的释放它
+}
+
 // Switch h/w page table register to the kernel-only page table,
-// for when no process is running.
+// at boot.  (Runs before mycpu() works, so it is not tracked in
+// c->pgdir; loadpgdir() will see a change on the first switch.)
 void switchkvm(void)
 {
   lcr3(V2P(kpgdir));   //加载内核页表到cr3寄存器，cr3存放的是页目录物理地址
 }
 
+// Move this CPU off the process page table it is still on, to
+// kpgdir, if the process has freed it meanwhile, so that an idle
+// CPU does not keep a dead page table.  (A process that exits
+// after this CPU halts has its page table freed when the CPU
+// next switches.)
+// Caller must have interrupts disabled.
+void
+dropuvm(void)
+{
+  struct cpu *c = mycpu();
+
+  if(c->pgdir && c->pgdir != kpgdir && kref((char*)c->pgdir) == 1)   //只剩本CPU的引用
+    loadpgdir(kpgdir, 0);
+}
+
+// Flush this CPU's TLB entries for user memory after the current
+// process's page table has changed.  (switchuvm() does not reload
+// an unchanged %cr3.)
+void
+flushtlb(void)
+{
+  lcr3(rcr3());
+}
+
 // Switch TSS and h/w page table to correspond to process p.
 void
 switchuvm(struct proc *p)
@@ -165,11 +263,17 @@ switchuvm(struct proc *p)
   mycpu()->gdt[SEG_TSS].s = 0;  //系统段
   mycpu()->ts.ss0 = SEG_KDATA << 3;   //更改SS为新栈的选择子
   mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;  //在TSS中记录内核栈地址
+  if(havesysenter)   //SYSENTER也用这个内核栈
+    wrmsr(MSR_SYSENTER_ESP, (uint)p->kstack + KSTACKSIZE);
   // setting IOPL=0 in eflags *and* iomb beyond the tss segment limit
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;   //用户态禁止使用io指令
   ltr(SEG_TSS << 3);      //加载TSS段的选择子到TR寄存器
-  lcr3(V2P(p->pgdir));  // switch to process's address space  换页表就是换地址空间
+  // This CPU's TLB may be stale even if %cr3 still holds
+  // p->pgdir: p may have run and changed its page table on
+  // another CPU since, or kswapd may have swapped pages out.
+  loadpgdir(p->pgdir, p->lastcpu != mycpu());  // switch to process's address space  换页表就是换地址空间
+  p->lastcpu = mycpu();
   popcli();
 }
 
@@ -187,31 +291,17 @@ void inituvm(pde_t *pgdir, char *init, uint sz)
   memmove(mem, init, sz);  //将要运行的初始化程序搬到0-4KB
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
+// kalloc(), except that when memory has run out it waits for
+// kswapd to swap some pages out and tries again.
+char*
+allocpage(void)
 {
-  uint i, pa, n;
-  pte_t *pte;
+  char *mem;
 
-  if((uint) addr % PGSIZE != 0)   //地址必须是对齐的
-    panic("loaduvm: addr must be page aligned");
-    
-  for(i = 0; i < sz; i += PGSIZE){  
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)  //addr+i地址所在页的页表项地址
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);  //页表项记录的物理地址
-
-    if(sz - i < PGSIZE)  //确定一次能够搬运的字节数
-      n = sz - i;
-    else
-      n = PGSIZE;
-      
-    if(readi(ip, P2V(pa), offset+i, n) != n) //调用readi将数据搬运到地址P2V(pa)处
-      return -1;
-  }
-  return 0;
+  while((mem = kalloc()) == 0)
+    if(swapwait() < 0)
+      return 0;
+  return mem;
 }
 
 // Allocate page tables and physical memory to grow process from oldsz to
@@ -230,7 +320,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)   //多分配一/几页物理内
   a = PGROUNDUP(oldsz);    //向上4K对齐
 
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();     //分配物理内存
+    mem = allocpage();     //分配物理内存，内存不够时等kswapd换出一些
     if(mem == 0){       //如果分配失败
         cprintf("allocuvm out of memory\n");
         deallocuvm(pgdir, newsz, oldsz);  //回收newsz到oldsz这部分空间
@@ -247,21 +337,84 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)   //多分配一/几页物理内
   return newsz;
 }
 
-// Deallocate user pages to bring the process size from oldsz to
-// newsz.  oldsz and newsz need not be page-aligned, nor does newsz
-// need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
-int
-deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)    //释放一/几页物理内存，页表项清0
+// Replace the superpage mapped by directory entry pde with a
+// page table of 4KB pages covering the same memory, so that
+// part of it can be unmapped.
+static int
+splitsuper(pde_t *pde)
+{
+  pte_t *pgtab;
+  uint pa, i;
+
+  if((pgtab = (pte_t*)kalloc()) == 0)
+    return -1;
+  pa = PTE_ADDR(*pde);
+  ksplit(P2V(pa));   //每个4K页都可以单独kfree了
+  for(i = 0; i < NPTENTRIES; i++)
+    pgtab[i] = (pa + i*PGSIZE) | (PTE_FLAGS(*pde) & ~PTE_PS);
+  *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
+  return 0;
+}
+
+// Flush the TLBs of all CPUs, and wait until the others have
+// done so: threads sharing an address space whose page table
+// has just lost entries may be running on any of them.
+void
+tlbshootdown(void)
+{
+  struct cpu *c;
+
+  pushcli();
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    if(c == mycpu() || !c->started)
+      continue;
+    c->tlbflush = 1;
+    lapicipi(c->apicid, T_IRQ0 + IRQ_TLB);
+  }
+  flushtlb();
+  popcli();
+  for(c = cpus; c < &cpus[ncpu]; c++)   //等它们都刷新完
+    while(c->tlbflush)
+      ;
+}
+
+#define NDEAD 64   // Pages unmapped per TLB shootdown
+
+// Unmap and free the user pages of pgdir in [newsz, oldsz).  If
+// shared, other CPUs may still hold TLB entries for them, so
+// pages are freed in batches, each after a TLB shootdown.
+static int
+unmapuvm(pde_t *pgdir, uint oldsz, uint newsz, int shared)
 {
+  char *dead[NDEAD];
   pte_t *pte;
   uint a, pa;
+  int ndead;
 
   if(newsz >= oldsz)
     return oldsz;
 
+  ndead = 0;
   a = PGROUNDUP(newsz);   //向上4K对齐
   for(; a  < oldsz; a += PGSIZE){
+    if(pgdir[PDX(a)] & PTE_PS){   //4M大页
+      if(a % SUPERPGSIZE == 0 && a + SUPERPGSIZE <= oldsz){  //整个大页都释放
+        pa = PTE_ADDR(pgdir[PDX(a)]);
+        pgdir[PDX(a)] = 0;
+        if(shared)
+          tlbshootdown();
+        ksuperfree(P2V(pa));
+        a += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      // Only part of it goes: break it into 4KB pages.  With no
+      // memory for the page table the whole superpage stays
+      // mapped until the address space is freed.
+      if(splitsuper(&pgdir[PDX(a)]) < 0){
+        a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+    }
     pte = walkpgdir(pgdir, (char*)a, 0);  //地址a所在页的页表项地址
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;  //
@@ -270,24 +423,66 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)    //释放一/几页物理内
       if(pa == 0)
         panic("kfree");
       char *v = P2V(pa);
-      kfree(v);
+      *pte = 0;
+      if(!shared){
+        kfree(v);
+        continue;
+      }
+      dead[ndead++] = v;
+      if(ndead == NDEAD){   //攒够一批，别的CPU刷过TLB再释放
+        tlbshootdown();
+        while(ndead > 0)
+          kfree(dead[--ndead]);
+      }
+    } else if(*pte & PTE_SWAP){   //已换出的页，释放交换槽
+      swapfree(*pte >> PTXSHIFT);
       *pte = 0;
     }
   }
+  if(ndead > 0){
+    tlbshootdown();
+    while(ndead > 0)
+      kfree(dead[--ndead]);
+  }
   return newsz;
 }
 
-// Free a page table and all the physical memory pages
-// in the user part.
-void freevm(pde_t *pgdir)
+// Deallocate user pages to bring the process size from oldsz to
+// newsz.  oldsz and newsz need not be page-aligned, nor does newsz
+// need to be less than oldsz.  oldsz can be larger than the actual
+// process size.  Returns the new process size.
+// The page table must not be in use on any other CPU.
+int
+deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)    //释放一/几页物理内存，页表项清0
+{
+  return unmapuvm(pgdir, oldsz, newsz, 0);
+}
+
+// deallocuvm() for p's memory, which threads may be using on
+// other CPUs, and flush the TLB.  Caller holds mmlock(p->pgdir).
+int
+shrinkuvm(struct proc *p, uint oldsz, uint newsz)
+{
+  int sz;
+
+  sz = unmapuvm(p->pgdir, oldsz, newsz, vmshared(p) > 0);
+  flushtlb();   //页表项被清除了，重新加载cr3刷新TLB
+  return sz;
+}
+
+// Drop one reference to page table pgdir: the owner's, from
+// freevm(), or a CPU's that has loaded another one.  The last
+// reference frees it.
+static void
+putvm(pde_t *pgdir)
 {
   uint i;
 
-  if(pgdir == 0)
-    panic("freevm: no pgdir");
+  if(kunref((char*)pgdir) > 0)   //还在某个CPU的cr3里
+    return;
   deallocuvm(pgdir, KERNBASE, 0);     //free 用户空间映射的物理内存
-  for(i = 0; i < NPDENTRIES; i++){    //free 页表占用的物理内存 
-    if(pgdir[i] & PTE_P){
+  for(i = 0; i < PDX(KERNBASE); i++){    //free 用户部分页表占用的物理内存
+    if((pgdir[i] & PTE_P) && !(pgdir[i] & PTE_PS)){   //4M大页没有页表
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
     }
@@ -295,6 +490,16 @@ void freevm(pde_t *pgdir)
   kfree((char*)pgdir);   //free 页目录占用的物理内存
 }
 
+// Free a page table and all the physical memory pages
+// in the user part.  The kernel part is shared; see setupkvm().
+// CPUs still on pgdir keep it until they switch away.
+void freevm(pde_t *pgdir)
+{
+  if(pgdir == 0)
+    panic("freevm: no pgdir");
+  putvm(pgdir);
+}
+
 // Clear PTE_U on a page. Used to create an inaccessible
 // page beneath the user stack.
 void
@@ -308,40 +513,83 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+// Give page table d the pages of pgdir that are present in
+// [start, end): private copies, or if share is set the same
+// physical pages, which kalloc() then counts as mapped twice.
+static int
+copyrange(pde_t *pgdir, pde_t *d, uint start, uint end, int share)
 {
-  pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
   char *mem;
 
-  if((d = setupkvm()) == 0)      //构造页表的内核部分，内核部分都是一样的
-    return 0;
-  for(i = 0; i < sz; i += PGSIZE){     //循环用户部分sz
+  for(i = start; i < end; i += PGSIZE){
+    // A heap superpage is copied whole if another one is free.
+    if((pgdir[PDX(i)] & PTE_PS) && !share && i % SUPERPGSIZE == 0 &&
+       i + SUPERPGSIZE <= end && (mem = ksuperalloc()) != 0){
+      memmove(mem, P2V(PTE_ADDR(pgdir[PDX(i)])), SUPERPGSIZE);
+      d[PDX(i)] = V2P(mem) | PTE_FLAGS(pgdir[PDX(i)]);
+      i += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    // Pages that were never touched have no PTE yet;
+    // the child faults them in on its own.
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)  //返回这个地址所在页的页表项地址，判断是否存在
-      panic("copyuvm: pte should exist");    //为0表示不存在,panic
-    if(!(*pte & PTE_P))    //判断页表项的P位
-      panic("copyuvm: page not present");  //如果是0表不存在，panic
+      continue;
+    if(*pte & PTE_SWAP){   //已换出的页，子进程的副本从交换区读回
+      if((mem = allocpage()) == 0)
+        return -1;
+      flags = PTE_FLAGS(*pte) & (PTE_W|PTE_U);
+      swapread(*pte >> PTXSHIFT, mem);
+      if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0){
+        kfree(mem);
+        return -1;
+      }
+      continue;
+    }
+    if(!(*pte & PTE_P))    //判断页表项的P位，还没分配的页不用复制
+      continue;
     pa = PTE_ADDR(*pte);     //获取该页的物理地址
     flags = PTE_FLAGS(*pte);  //获取该页的属性
-      
-    if((mem = kalloc()) == 0)  //分配一页
-      goto bad;
+    if(*pte & PTE_PS){   //否则子进程用4K页复制大页中的这一页
+      pa += i % SUPERPGSIZE;
+      flags &= ~PTE_PS;
+    }
+
+    if(share){    //共享映射：父子进程映射同一物理页
+      if(mappages(d, (void*)i, PGSIZE, pa, flags & ~PTE_D) < 0)
+        return -1;
+      kdup(P2V(pa));
+      continue;
+    }
+    if((mem = allocpage()) == 0)  //分配一页
+      return -1;
     memmove(mem, (char*)P2V(pa), PGSIZE);  //复制该页数据
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {  //映射该物理页到新的虚拟地址
       kfree(mem);   //如果出错释放
-      goto bad;
+      return -1;
     }
   }
-  return d;     //返回页目录虚拟地址
-bad:
-  freevm(d);    //释放页目录d指示的所有空间
   return 0;
 }
 
+// Given a parent process's page table, create a copy
+// of it for a child.  Only [0, sz) is copied; vmadup()
+// takes care of the mmap() regions above sz.
+pde_t*
+copyuvm(pde_t *pgdir, uint sz)
+{
+  pde_t *d;
+
+  if((d = setupkvm()) == 0)      //构造页表的内核部分，内核部分都是一样的
+    return 0;
+  if(copyrange(pgdir, d, 0, sz, 0) < 0){   //循环用户部分sz
+    freevm(d);    //释放页目录d指示的所有空间
+    return 0;
+  }
+  return d;     //返回页目录虚拟地址
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -354,6 +602,8 @@ uva2ka(pde_t *pgdir, char *uva)
     return 0;
   if((*pte & PTE_U) == 0)  //如果用户不能访问
     return 0;
+  if(*pte & PTE_PS)   //4M大页
+    return (char*)P2V(PTE_ADDR(*pte)) + PGROUNDDOWN((uint)uva % SUPERPGSIZE);
   return (char*)P2V(PTE_ADDR(*pte));  //返回该页对应的内核地址
 }
 
@@ -383,10 +633,604 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+//PAGEBREAK!
+// Return the demand-paged region of p containing va, or 0.
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Back the whole 4MB-aligned stretch of heap around va with
+// one superpage, if all of it lies below p->sz, none of it is
+// mapped yet and no region overlaps it.  One 4MB clear then
+// replaces 1024 faults, a page table page and 1024 TLB entries.
+static int
+superfault(struct proc *p, uint va)
+{
+  struct vma *v;
+  uint base;
+  char *mem;
+
+  base = va & ~(SUPERPGSIZE-1);
+  if(base + SUPERPGSIZE > p->sz || (p->pgdir[PDX(base)] & PTE_P))
+    return -1;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end && v->start < base + SUPERPGSIZE && base < v->end)
+      return -1;
+  if((mem = ksuperalloc()) == 0)
+    return -1;
+  memset(mem, 0, SUPERPGSIZE);
+  p->pgdir[PDX(base)] = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+  return 0;
+}
+
+// The work of pagefault().  Caller holds mmlock(p->pgdir).
+static int
+fault(struct proc *p, uint va, uint err)
+{
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+  int perm, n;
+
+  v = findvma(p, va);
+  if(v == 0 && va >= p->sz)   //既不在堆里也不在映射区域里
+    return -1;
+  perm = v ? v->perm : PTE_W|PTE_U;
+  if((err & FEC_WR) && !(perm & PTE_W))  //写只读映射
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_P))   //同一地址空间的另一个线程刚把它调进来
+    return 0;
+  if(v == 0 && superfault(p, va) == 0)   //大块的堆尽量用4M大页
+    return 0;
+
+  // A shared file page maps the frame in the page cache, the
+  // same one every other process mapping it maps.
+  if(v && v->ip && (v->flags & MAP_SHARED) && va - v->start < v->filesz){
+    n = v->filesz - (va - v->start);
+    if(n > PGSIZE)
+      n = PGSIZE;
+    if((mem = pcget(v->ip, v->off + (va - v->start), n)) == 0){
+      cprintf("pid %d %s: pagefault out of memory or page cache\n", p->pid, p->name);
+      return -1;
+    }
+    if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+      kfree(mem);
+      return -1;
+    }
+    return 0;
+  }
+
+  if((mem = allocpage()) == 0){
+    cprintf("pid %d %s: pagefault out of memory\n", p->pid, p->name);
+    return -1;
+  }
+
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_SWAP)){   //被换出的页，从交换区读回
+    n = *pte >> PTXSHIFT;
+    swapread(n, mem);
+    if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0)
+      panic("pagefault: swap");
+    swapfree(n);
+    return 0;
+  }
+  memset(mem, 0, PGSIZE);   //清零，bss和堆都是全0
+
+  // File-backed part of a region: read it in.  Bytes
+  // past the end of the file read as zeros.
+  if(v && v->ip && va - v->start < v->filesz){
+    n = v->filesz - (va - v->start);
+    if(n > PGSIZE)
+      n = PGSIZE;
+    ilockshared(v->ip);   //许多进程可能同时从同一个程序文件调页
+    readi(v->ip, mem, v->off + (va - v->start), n);  //从文件读取这一页
+    iunlockshared(v->ip);
+  }
+
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Handle a page fault at user virtual address va taken by the
+// current process; err is the error code the CPU pushed.
+// Nothing below p->sz is loaded eagerly except the user stack:
+// program segments recorded by exec() are read from their inode
+// here a page at a time, and heap pages reserved by growproc()
+// are backed with a fresh zeroed page, or superpage.  Above
+// p->sz only the regions set up by mmap() are valid.  Pages
+// that kswapd has swapped out are read back from swap.
+// Returns 0 if the fault was resolved, -1 if the access was bad
+// or the page could not be filled in.
+int
+pagefault(uint va, uint err)
+{
+  struct proc *p = myproc();
+  int r;
+
+  if(p == 0 || (err & FEC_PR))  //页存在(保护错误)不是按需调页的缺页
+    return -1;
+  mmlock(p->pgdir);
+  r = fault(p, va, err);
+  mmunlock(p->pgdir);
+  return r;
+}
+
+// Make sure the current process's pages covering [va, va+n)
+// are present before the kernel touches them directly, so
+// that no page fault is taken inside the kernel (possibly with
+// spinlocks held).  Fails if some page is not user memory, or
+// is read-only and write is set.  If locked, the caller holds
+// mmlock(); otherwise it is taken only if a page is missing.
+static int
+faultin(uint va, uint n, int write, int locked)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint a, last;
+  int r;
+
+  if(n == 0)
+    return 0;
+  if(va + n < va)
+    return -1;
+  if(p->insyscall){   //这段内存在本次系统调用里要直接访问，pinwait()得等
+    if(p->pinhi == 0 || va < p->pinlo)
+      p->pinlo = va;
+    if(p->pinhi == 0 || va + n > p->pinhi)
+      p->pinhi = va + n;
+    __sync_synchronize();
+    if(p->unmaphi && va < p->unmaphi && p->unmaplo < va + n)  //别的线程正在解除它的映射
+      return -1;
+  }
+  a = PGROUNDDOWN(va);
+  last = PGROUNDDOWN(va + n - 1);
+  for(;;){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte == 0 || (*pte & PTE_P) == 0){
+      if(!locked)
+        mmlock(p->pgdir);
+      r = fault(p, a, write ? FEC_WR : 0);
+      if(!locked)
+        mmunlock(p->pgdir);
+      if(r < 0)
+        return -1;
+    }
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(!(*pte & PTE_U) || (write && !(*pte & PTE_W)))  //栈下的保护页或只读映射
+      return -1;
+    if(a == last)
+      break;
+    a += PGSIZE;
+  }
+  return 0;
+}
+
+int
+prefault(uint va, uint n, int write)
+{
+  return faultin(va, n, write, 0);
+}
+
+// Write the dirty pages of region v that lie in [start, end)
+// back to its file, if v is a MAP_SHARED file mapping.  Only
+// bytes that fall inside the file are written: stores past its
+// end do not grow it.
+static void
+vmawriteback(pde_t *pgdir, struct vma *v, uint start, uint end)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;  //一个事务最多写这么多字节，同filewrite
+  uint a, off, n, n1, i;
+  pte_t *pte;
+  char *mem;
+
+  if(pgdir == 0 || !(v->flags & MAP_SHARED) || v->ip == 0)
+    return;
+  for(a = start; a < end && a - v->start < v->filesz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(pte == 0 || !(*pte & PTE_P) || !(*pte & PTE_D))  //没有被写过的页不用写回
+      continue;
+    mem = P2V(PTE_ADDR(*pte));
+    off = v->off + (a - v->start);
+    n = v->filesz - (a - v->start);
+    if(n > PGSIZE)
+      n = PGSIZE;
+    for(i = 0; i < n; i += n1){
+      n1 = n - i;
+      if(n1 > max)
+        n1 = max;
+      begin_op();
+      ilock(v->ip);
+      if(off + i >= v->ip->size)
+        n1 = n;
+      else {
+        if(off + i + n1 > v->ip->size)
+          n1 = v->ip->size - (off + i);
+        writei(v->ip, mem + i, off + i, n1);
+      }
+      iunlock(v->ip);
+      end_op();
+    }
+    *pte &= ~PTE_D;
+  }
+}
+
+// Find len bytes of unused address space for mmap(), as high
+// as possible below KERNBASE so that the heap has room to grow
+// up towards it.  Returns 0 if there is no such hole.
+static uint
+mmapaddr(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint a;
+
+  if(len > KERNBASE)
+    return 0;
+  a = KERNBASE - len;
+again:
+  if(a < PGROUNDUP(p->sz))
+    return 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end && v->start < a + len && a < v->end){  //与已有区域重叠，移到它下面
+      if(v->start < len)
+        return 0;
+      a = v->start - len;
+      goto again;
+    }
+  }
+  return a;
+}
+
+// Map len bytes of file f from offset off, or zero-filled
+// memory if flags has MAP_ANONYMOUS, into the current process.
+// Nothing is allocated here; pagefault() fills the pages in as
+// they are touched.  Returns the address of the mapping, or -1.
+int
+mmap(struct file *f, uint off, uint len, int prot, int flags)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv;
+  uint a;
+
+  if(len == 0 || off % PGSIZE != 0)
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(!(flags & MAP_ANONYMOUS)){
+    if(f == 0 || f->type != FD_INODE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;  //只读打开的文件不能共享可写映射
+    if(f->ip->type != T_FILE)
+      return -1;
+  }
+
+  mmlock(p->pgdir);
+  nv = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end == 0){
+      nv = v;
+      break;
+    }
+  len = PGROUNDUP(len);
+  if(nv == 0 || len == 0 || (a = mmapaddr(p, len)) == 0){
+    mmunlock(p->pgdir);
+    return -1;
+  }
+
+  nv->start = a;
+  nv->end = a + len;
+  nv->perm = PTE_U | ((prot & PROT_WRITE) ? PTE_W : 0);
+  nv->flags = flags & (MAP_SHARED|MAP_PRIVATE);
+  nv->shm = 0;
+  if(flags & MAP_ANONYMOUS){
+    nv->ip = 0;
+    nv->off = 0;
+    nv->filesz = 0;
+  } else {
+    nv->ip = idup(f->ip);
+    nv->off = off;
+    nv->filesz = len;
+  }
+  vmsync(p);
+  mmunlock(p->pgdir);
+  return a;
+}
+
+// Map the npages physical pages in pages[] into the current
+// process as one shared region belonging to segment s.
+// Returns the address of the region, or -1.
+int
+mapshm(struct shm *s, char **pages, int npages)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint a;
+  int i;
+
+  mmlock(p->pgdir);
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end == 0)
+      break;
+  if(v == &p->vma[NVMA] || (a = mmapaddr(p, npages*PGSIZE)) == 0){
+    mmunlock(p->pgdir);
+    return -1;
+  }
+  for(i = 0; i < npages; i++){
+    kdup(pages[i]);   //这个页表也映射了这一页
+    if(mappages(p->pgdir, (char*)a + i*PGSIZE, PGSIZE, V2P(pages[i]), PTE_W|PTE_U) < 0){
+      kfree(pages[i]);
+      deallocuvm(p->pgdir, a + i*PGSIZE, a);
+      mmunlock(p->pgdir);
+      return -1;
+    }
+  }
+  memset(v, 0, sizeof(*v));
+  v->start = a;
+  v->end = a + npages*PGSIZE;
+  v->perm = PTE_W|PTE_U;
+  v->flags = MAP_SHARED;
+  v->shm = s;
+  vmsync(p);
+  mmunlock(p->pgdir);
+  return a;
+}
+
+// The work of munmap().  Caller holds mmlock(p->pgdir).
+static int
+unmap(struct proc *p, uint addr, uint len)
+{
+  struct vma *v, *nv;
+  uint start, end, cut;
+  int nfree, nsplit;
+
+  if(addr % PGSIZE != 0 || len == 0 || addr + len < addr)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  if(end > KERNBASE || end == 0)
+    return -1;
+
+  // Check everything before changing anything, so that a
+  // failure leaves all regions as they were.
+  nfree = nsplit = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end == 0){
+      nfree++;
+      continue;
+    }
+    if(v->flags == 0 || v->end <= addr || end <= v->start)
+      continue;
+    if(v->shm && (addr > v->start || end < v->end))   //共享内存段只能整个拆掉
+      return -1;
+    if(addr > v->start && end < v->end)   //从中间挖掉一段，需要一个新区域
+      nsplit++;
+  }
+  if(nsplit > nfree)
+    return -1;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end == 0 || v->flags == 0 || v->end <= addr || end <= v->start)
+      continue;
+    start = addr > v->start ? addr : v->start;
+    cut = end < v->end ? end : v->end;
+
+    nv = 0;
+    if(start > v->start && cut < v->end)   //前面检查过，一定有空闲区域
+      for(nv = p->vma; nv->end != 0; nv++)
+        ;
+
+    vmawriteback(p->pgdir, v, start, cut);
+    shrinkuvm(p, cut, start);   //释放这段的物理页
+    if(v->ip && (v->flags & MAP_SHARED))
+      pctrim(v->ip);   //没人映射的页不必留在页缓存里
+
+    if(nv){
+      *nv = *v;
+      nv->start = cut;
+      nv->off += cut - v->start;
+      nv->filesz = v->filesz > cut - v->start ? v->filesz - (cut - v->start) : 0;
+      if(nv->ip)
+        idup(nv->ip);
+      v->end = start;
+      if(v->filesz > start - v->start)
+        v->filesz = start - v->start;
+    } else if(start > v->start){   //切掉尾部
+      v->end = start;
+      if(v->filesz > start - v->start)
+        v->filesz = start - v->start;
+    } else if(cut < v->end){   //切掉头部
+      v->off += cut - v->start;
+      v->filesz = v->filesz > cut - v->start ? v->filesz - (cut - v->start) : 0;
+      v->start = cut;
+    } else {   //整个区域都没了
+      if(v->ip){
+        begin_op();
+        iput(v->ip);
+        end_op();
+      }
+      if(v->shm)
+        shmput(v->shm);
+      v->end = 0;
+      v->ip = 0;
+      v->shm = 0;
+    }
+  }
+  flushtlb();   //刷新TLB
+  return 0;
+}
+
+// Detach the shared memory segment mapped at addr from the
+// current process.
+int
+shmdetach(uint addr)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint end;
+  int r;
+
+  mmlock(p->pgdir);
+  v = findvma(p, addr);
+  if(v == 0 || v->shm == 0 || v->start != addr){
+    mmunlock(p->pgdir);
+    return -1;
+  }
+  end = v->end;
+  mmunlock(p->pgdir);
+
+  pinwait(addr, end);   //别的线程的系统调用还在用这段内存
+  mmlock(p->pgdir);
+  v = findvma(p, addr);   //放锁期间可能被别的线程拆掉了
+  if(v == 0 || v->shm == 0 || v->start != addr || v->end != end)
+    r = -1;
+  else
+    r = unmap(p, addr, end - addr);
+  vmsync(p);
+  mmunlock(p->pgdir);
+  unpin();
+  return r;
+}
+
+// Remove the mmap() regions of the current process in
+// [addr, addr+len), writing dirty shared pages back first.
+// A region may be cut at either end or split in two, except
+// for shared memory segments, which go as a whole.  Waits for
+// the system calls of other threads that use the range first.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *p = myproc();
+  int r;
+
+  if(addr + len < addr)
+    return -1;
+  pinwait(addr, addr + len);
+  mmlock(p->pgdir);
+  r = unmap(p, addr, len);
+  vmsync(p);
+  mmunlock(p->pgdir);
+  unpin();
+  return r;
+}
+
+// Copy p's regions into the new child np, whose page table
+// already holds [0, p->sz).  Private mappings get copies of the
+// pages p has touched, shared ones the same frames.  Shared file
+// pages p has not touched are left alone: whichever process
+// touches one first gets it from the page cache, the other the
+// same frame.  Shared anonymous memory has nothing behind it, so
+// it is first faulted in completely in p.
+int
+vmadup(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->vma[i];
+    np->vma[i] = *v;
+    if(v->end == 0)
+      continue;
+    if(v->ip)
+      idup(v->ip);
+    if(v->shm)
+      shmdup(v->shm);
+    if(v->flags == 0)   //程序段在sz以下，copyuvm已经复制过了
+      continue;
+    if((v->flags & MAP_SHARED) && v->ip == 0 && v->shm == 0 &&
+       faultin(v->start, v->end - v->start, 0, 1) < 0)
+      return -1;
+    if(copyrange(p->pgdir, np->pgdir, v->start, v->end, v->flags & MAP_SHARED) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Drop the regions in vma[NVMA], writing dirty shared pages
+// mapped in pgdir back to their files first (pgdir may be 0
+// if there are none), and mark them unused.  The pages
+// themselves go with freevm().  Called when a process exits
+// or replaces its image in exec().
+void
+vmaput(pde_t *pgdir, struct vma *vma)
+{
+  struct vma *v;
+
+  for(v = vma; v < &vma[NVMA]; v++)
+    if(v->end)
+      vmawriteback(pgdir, v, v->start, v->end);
+  begin_op();   //iput可能释放inode，需要在事务中
+  for(v = vma; v < &vma[NVMA]; v++){
+    if(v->end && v->ip)
+      iput(v->ip);
+    if(v->end && v->shm)
+      shmput(v->shm);
+    v->end = 0;
+    v->ip = 0;
+    v->shm = 0;
+  }
+  end_op();
+}
+
+// Clock hand of swapout(): look at the pages of p from *va up,
+// giving each page that has been used recently a second chance
+// by clearing its accessed bit.  The first one that has not is
+// unmapped, its PTE pointing at swap slot instead, and its
+// frame returned to be written out; *va is left just past it.
+// Pages of shared mappings and superpages are never swapped
+// out.  Returns 0 once the end of user space is reached.
+// Caller must keep p from running (see swapout()).
+char*
+swapscan(struct proc *p, uint *va, int slot)
+{
+  struct vma *v;
+  pde_t *pde;
+  pte_t *pte;
+  char *mem;
+  uint a;
+
+  for(a = *va; a < KERNBASE; a += PGSIZE){
+    pde = &p->pgdir[PDX(a)];
+    if(!(*pde & PTE_P) || (*pde & PTE_PS)){   //没有页表，或是4M大页
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    pte = (pte_t*)P2V(PTE_ADDR(*pde)) + PTX(a);
+    if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))   //未映射的页和栈下的保护页
+      continue;
+    v = findvma(p, a);
+    if(v && ((v->flags & MAP_SHARED) || v->shm))   //共享的页映射在多个页表里
+      continue;
+    if(*pte & PTE_A){   //最近访问过，再给一次机会
+      *pte &= ~PTE_A;
+      p->lastcpu = 0;   //TLB里的表项还带着A位，下次运行时要刷掉
+      continue;
+    }
+    *va = a + PGSIZE;
+    mem = P2V(PTE_ADDR(*pte));
+    *pte = (slot << PTXSHIFT) | (*pte & (PTE_W|PTE_U)) | PTE_SWAP;
+    p->lastcpu = 0;
+    return mem;
+  }
+  *va = KERNBASE;
+  return 0;
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
 // Blank page.
-
@@ -1,29 +1,75 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "syscall.h"
+#include "ring.h"
 
-char buf[512];
+#define NBUF 8
+
+char buf[NBUF][512];
+struct ring ring;
+int l, w, c, inword;
+
+// Count the lines, words and bytes in the n bytes at p.
+void
+count(char *p, int n)
+{
+  int i;
+
+  for(i=0; i<n; i++){    //读取了多少个字符，循环多少次
+    c++;     
+    if(p[i] == '\n')   //有换行
+      l++;     //行数加1
+    if(strchr(" \r\t\n\v", p[i]))  //有空白字符
+      inword = 0;   
+    else if(!inword){  
+      w++;              //单词数加1
+      inword = 1;
+    }
+  }
+}
+
+// Read all of fd, NBUF blocks to a ringenter(), which would
+// take NBUF read() calls.  Not for devices, where reading on
+// past the end of the input waits.  Returns -1 on a read error.
+int
+ringread(int fd)
+{
+  struct cqe rd;
+  int i, done;
+
+  done = 0;
+  while(!done){
+    for(i = 0; i < NBUF; i++)
+      ring_queue(&ring, SYS_read, 0, i, fd, (int)buf[i], sizeof(buf[i]));
+    if(ringenter(NBUF) != NBUF)
+      return -1;
+    for(i = 0; i < NBUF; i++){   //按提交的顺序完成，也就是文件中的顺序
+      ring_reap(&ring, &rd);
+      if(rd.res < 0)
+        return -1;
+      if(rd.res == 0)   //读到文件尾了
+        done = 1;
+      else if(!done)
+        count(buf[rd.data], rd.res);
+    }
+  }
+  return 0;
+}
 
 void
-wc(int fd, char *name)
+wc(int fd, char *name, int ringok)
 {
-  int i, n;
-  int l, w, c, inword;
+  struct stat st;
+  int n;
 
   l = w = c = 0;
   inword = 0;
-  while((n = read(fd, buf, sizeof(buf))) > 0){  //从fd指向的文件中读取数据
-    for(i=0; i<n; i++){    //读取了多少个字符，循环多少次
-      c++;     
-      if(buf[i] == '\n')   //有换行
-        l++;     //行数加1
-      if(strchr(" \r\t\n\v", buf[i]))  //有空白字符
-        inword = 0;   
-      else if(!inword){  
-        w++;              //单词数加1
-        inword = 1;
-      }
-    }
+  if(ringok && fstat(fd, &st) == 0 && st.type != T_DEV)
+    n = ringread(fd);   //一次陷入读多块
+  else {
+    while((n = read(fd, buf[0], sizeof(buf[0]))) > 0)  //从fd指向的文件中读取数据
+      count(buf[0], n);
   }
   if(n < 0){       //没有读取到字符
     printf(1, "wc: read error\n");   
@@ -35,19 +81,20 @@ wc(int fd, char *name)
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int fd, i, ringok;
 
   if(argc <= 1){   //如果参数≤1
-    wc(0, "");     //从键盘获取输入
+    wc(0, "", 0);     //从键盘获取输入
     exit();        //执行完退出
   }
 
+  ringok = ringsetup(&ring) == 0;
   for(i = 1; i < argc; i++){   //从第一个参数开始循环(0起始)
     if((fd = open(argv[i], 0)) < 0){    //打开参数指向的文件
       printf(1, "wc: cannot open %s\n", argv[i]);
       exit();
     }
-    wc(fd, argv[i]);   //统计这个文件
+    wc(fd, argv[i], ringok);   //统计这个文件
     close(fd);    //关闭文件描述符
   }
   exit();   //执行完后退出
@@ -117,6 +117,41 @@ sti(void)   //开中断
   asm volatile("sti");
 }
 
+// Enable interrupts and wait for one.  sti takes effect only
+// after the next instruction, so no interrupt can slip in
+// between it and the hlt and leave the CPU halted.
+static inline void
+halt(void)   //开中断并停机，直到来中断
+{
+  asm volatile("sti; hlt");
+}
+
+// Read the time-stamp counter, which counts CPU cycles.
+static inline uint64
+rdtsc(void)   //读时间戳计数器
+{
+  uint64 val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
+// Write val to model-specific register msr.
+static inline void
+wrmsr(uint msr, uint64 val)   //写MSR寄存器
+{
+  asm volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
+// The feature flags CPUID leaf 1 returns in %edx.
+static inline uint
+cpufeatures(void)   //CPU支持的特性
+{
+  uint a, b, c, d;
+
+  asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1));
+  return d;
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)   //交换*addr和newval，返回*addr
 {
@@ -130,6 +165,34 @@ xchg(volatile uint *addr, uint newval)   //交换*addr和newval，返回*addr
   return result;
 }
 
+static inline uint
+xadd(volatile uint *addr, uint n)   //*addr加n，返回加之前的*addr
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (n), "+m" (*addr) :
+               :
+               "cc");
+  return n;
+}
+
+static inline void
+pause(void)   //自旋等待时提示CPU，省电也让出流水线给超线程
+{
+  asm volatile("pause");
+}
+
+static inline uint
+cmpxchg(volatile uint *addr, uint old, uint newval)   //若*addr等于old则换成newval，返回原来的*addr
+{
+  uint result;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (result), "+m" (*addr) :
+               "r" (newval), "0" (old) :
+               "cc");
+  return result;
+}
+
 static inline uint
 rcr2(void)  //返回寄存器cr2，CR2是页故障线性地址寄存器，保存最后一次出现页故障的全32位线性地址
 {
@@ -144,6 +207,14 @@ lcr3(uint val)  //加载val到寄存器cr3
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint
+rcr3(void)  //返回寄存器cr3，当前页目录的物理地址
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().